@@ -1,5 +1,11 @@
 // wav_quant_dec_fixed.cpp
 #include "bit_stream.h"
+#include "bit_lanes.h"
+#include "wav_file.h"
+#include "dct_header.h"
+#include "dct_plan.h"
+#include "dct_entropy.h"
+#include "dct_float.h"
 #include <fftw3.h>
 #include <fstream>
 #include <vector>
@@ -9,6 +15,9 @@
 #include <cstring>
 #include <sys/stat.h>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <memory>
 
 using namespace std;
 
@@ -18,33 +27,36 @@ uint64_t file_size_bytes(const string &path) {
     return static_cast<uint64_t>(st.st_size);
 }
 
-void write_little_endian(ofstream &ofs, uint32_t value, int bytes) {
-    for (int i = 0; i < bytes; ++i) {
-        uint8_t b = (value >> (8 * i)) & 0xFF;
-        ofs.put(static_cast<char>(b));
-    }
+// Tempo em segundos: "s", "m:s" ou "h:m:s" (os segundos podem ter casas decimais)
+double parse_time(const string &t) {
+    double secs = 0;
+    size_t pos = 0;
+    for (size_t colon; (colon = t.find(':', pos)) != string::npos; pos = colon + 1)
+        secs = (secs + stoi(t.substr(pos, colon - pos))) * 60;
+    return secs + stod(t.substr(pos));
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 6) {
-        cerr << "Usage: " << argv[0] << " <input.enc> <output.wav> <n_bits> <channels(=1)> <sample_rate> [orig_bits]\n";
+    // Treino único da wisdom do FFTW (dct_plan.h), usada depois por todas as execuções
+    if (int status = dct_train_wisdom_option(argc, argv); status >= 0)
+        return status;
+
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <input.enc> <output.wav>\n";
+        cerr << "       [ -b firstBlock ] [ -nb numBlocks ] (decodifica apenas esses blocos)\n";
+        cerr << "       [ --from time ] [ --to time ] (só esse excerto; s, m:s ou h:m:s)\n";
+        cerr << "       [ -t threads ] (por omissão, um por core)\n";
+        cerr << "       [ -k K ] (blocos por IDCT em lote; por omissão, o que cabe na cache L2)\n";
+        cerr << "       [ -float ] (IDCT em precisão simples, dct_float.h, em vez do FFTW)\n";
+        cerr << "   or, for old DCT1/DCTL files:\n";
+        cerr << "       " << argv[0] << " <input.enc> <output.wav> <n_bits> <channels(=1)> <sample_rate> [orig_bits] [ -b ... ]\n";
+        cerr << "       " << argv[0] << " --train-wisdom [ blockSize ... ]\n";
         return 1;
     }
-    
+
 
     string in_path  = argv[1];
     string out_path = argv[2];
-    int n_bits = stoi(argv[3]);
-    int channels = stoi(argv[4]); // expect 1
-    int sample_rate = stoi(argv[5]);
-    int orig_bits = 16;
-    if (argc >= 7) orig_bits = stoi(argv[6]);
-
-    const uint64_t q_levels = (1ULL << n_bits);
-    uint64_t coeffs_read = 0;
-    const size_t SHOW_N = 64;
-    vector<uint64_t> first_qs;
-    first_qs.reserve(SHOW_N);
 
     fstream ifs_enc { in_path, ios::in | ios::binary };
     if (!ifs_enc.is_open()) {
@@ -53,56 +65,190 @@ int main(int argc, char* argv[]) {
     }
 
     // --- HEADER LEITURA ---
-    uint32_t magic;
-    uint16_t header_bs, header_keep;
-    
+    // "DCT2" e "DCTE" (dct_header.h) têm todos os parâmetros; "DCT1"/"DCTL"
+    // só bs e keep_sz, e os restantes vêm da linha de comando
+    uint32_t magic = 0;
     ifs_enc.read(reinterpret_cast<char*>(&magic), sizeof(magic));
-    ifs_enc.read(reinterpret_cast<char*>(&header_bs), sizeof(header_bs));
-    ifs_enc.read(reinterpret_cast<char*>(&header_keep), sizeof(header_keep));
-    
-    if (magic != 0x44435431) {
-        cerr << "Formato inválido ou ficheiro corrompido (magic != DCT1)\n";
+
+    DctHeader hdr;
+    const bool has_header = magic == DctHeader::MAGIC || magic == DctHeader::ENTROPY_MAGIC;
+    const bool entropy = magic == DctHeader::ENTROPY_MAGIC; // coeficientes em Golomb-Rice (dct_entropy.h)
+    bool use_lanes = magic == DCTL_MAGIC; // os blocos estão num contentor multi-lane (bloco b na lane b % N)
+    off_t header_bytes; // Os coeficientes começam logo a seguir ao header
+    int n_bits, channels, sample_rate;
+    int orig_bits = 16;
+    int first_opt = 3;
+    if (has_header) {
+        if (!hdr.read(ifs_enc) || (entropy && hdr.n_bits > DCTE_MAX_BITS)) {
+            cerr << "Cabeçalho DCT2/DCTE inválido\n";
+            return 1;
+        }
+        hdr.entropy = entropy;
+        n_bits = hdr.n_bits;
+        channels = hdr.channels;
+        sample_rate = hdr.sample_rate;
+        orig_bits = hdr.orig_bits;
+        use_lanes = hdr.n_lanes > 0;
+        header_bytes = DctHeader::SIZE;
+    } else if (magic == DCT1_MAGIC || use_lanes) {
+        if (argc < 6 || argv[3][0] == '-') {
+            cerr << "Ficheiro DCT1/DCTL sem parâmetros: give <n_bits> <channels> <sample_rate>\n";
+            return 1;
+        }
+        ifs_enc.read(reinterpret_cast<char*>(&hdr.bs), sizeof(hdr.bs));
+        ifs_enc.read(reinterpret_cast<char*>(&hdr.keep_sz), sizeof(hdr.keep_sz));
+        n_bits = stoi(argv[3]);
+        channels = stoi(argv[4]); // expect 1
+        sample_rate = stoi(argv[5]);
+        if (argc >= 7 && argv[6][0] != '-') orig_bits = stoi(argv[6]);
+        header_bytes = sizeof(magic) + sizeof(hdr.bs) + sizeof(hdr.keep_sz);
+        first_opt = 6;
+
+        if (channels != 1) {
+            cerr << "DCT1/DCTL files hold only channel 0 (channels==1)\n";
+            return 1;
+        }
+    } else {
+        cerr << "Formato inválido ou ficheiro corrompido (magic != DCT2/DCTE/DCT1/DCTL)\n";
         return 1;
     }
-    
-    size_t bs = header_bs;
-    size_t keep_sz = header_keep;
-    
-    cout << "Header lido: bs=" << bs << " keep_sz=" << keep_sz
-         << " (frac = " << (double)keep_sz / bs << ")\n";
 
-    if (channels != 1) {
-        cerr << "This decoder expects mono (channels==1)\n";
-        return 1;
+    // Intervalo de blocos ou de tempo opcional e número de workers
+    size_t firstBlock = 0;
+    size_t numBlocksReq = 0; // 0 = até ao fim
+    double fromSec = -1, toSec = -1; // < 0 = sem limite
+    int n_threads = max(1u, thread::hardware_concurrency());
+    int k_blocks = 0;
+    for (int n = first_opt; n < argc - 1; n++) {
+        if (string(argv[n]) == "-k") k_blocks = max(1, stoi(argv[n+1]));
+        if (string(argv[n]) == "-b") firstBlock = stoul(argv[n+1]);
+        if (string(argv[n]) == "-nb") numBlocksReq = stoul(argv[n+1]);
+        if (string(argv[n]) == "-t") n_threads = max(1, stoi(argv[n+1]));
+        if (string(argv[n]) == "--from") fromSec = parse_time(argv[n+1]);
+        if (string(argv[n]) == "--to") toSec = parse_time(argv[n+1]);
     }
+    // IDCT em float (-float) com o motor de dct_float.h em vez do FFTW
+    bool use_float = false;
+    for (int n = first_opt; n < argc; n++)
+        if (string(argv[n]) == "-float") use_float = true;
+
+    const uint64_t q_levels = (1ULL << n_bits);
+    uint64_t coeffs_read = 0;
+    const size_t SHOW_N = 64;
+    vector<uint64_t> first_qs;
+    first_qs.reserve(SHOW_N);
+
+    size_t bs = hdr.bs;
+    size_t keep_sz = hdr.keep_sz;
+
+    cout << "Header lido: bs=" << bs << " keep_sz=" << keep_sz
+         << " (frac = " << (double)keep_sz / bs << ") channels=" << channels
+         << (entropy ? " (modo entrópico)" : "") << "\n";
 
     // Preparacao para leitura dos dados codificados
 
     uint64_t in_size = file_size_bytes(in_path);
-    if (in_size == 0) {
+    if (in_size <= static_cast<uint64_t>(header_bytes)) {
         cerr << "Cannot stat input file or file empty: " << in_path << "\n";
         return 1;
     }
     cout << "Encoded file bytes: " << in_size << "\n";
 
-    const uint64_t total_bits = in_size * 8ULL;
-    const uint64_t total_coeffs = total_bits / static_cast<uint64_t>(n_bits);
     if (keep_sz < 1) keep_sz = 1;
 
-    if (total_coeffs < keep_sz) {
+    // Um bloco ocupa, canal a canal, keep_sz coeficientes quantizados (no
+    // modo entrópico, com tamanho variável)
+    const size_t rec = keep_sz * channels;
+    const uint64_t rec_bits = static_cast<uint64_t>(rec) * n_bits;
+    const size_t nBands = (keep_sz + DCTE_BAND - 1) / DCTE_BAND;
+    const double delta = dcte_delta(min(n_bits, DCTE_MAX_BITS));
+
+    unique_ptr<BitLaneReader> lanes;
+    uint64_t total_bits = (in_size - header_bytes) * 8ULL;
+    if (use_lanes) { // Só contam blocos completos de cada lane
+        lanes = make_unique<BitLaneReader>(in_path, header_bytes);
+        if (!lanes->is_open()) {
+            cerr << "Contentor multi-lane inválido\n";
+            return 1;
+        }
+        total_bits = 0;
+        for (int l = 0; l < lanes->n_lanes() && !entropy; ++l)
+            total_bits += lanes->lane_bits(l) / rec_bits * rec_bits;
+        cout << "Multi-lane: " << lanes->n_lanes() << " lanes\n";
+    }
+
+    if (!entropy && total_bits < rec_bits) {
         cerr << "Not enough coefficients in file\n";
         return 1;
     }
 
-    // nBlocks inferred (must corresponder ao encoder)
-    size_t nBlocks = static_cast<size_t>(total_coeffs / keep_sz);
+    // nBlocks inferred (must corresponder ao encoder); com cabeçalho DCT2 o
+    // número exato de frames dá também o dos blocos (no modo entrópico, só ele),
+    // e um ficheiro com menos blocos do que esses foi cortado
+    size_t nBlocks = entropy ? 0 : static_cast<size_t>(total_bits / rec_bits);
+    if (has_header) {
+        const size_t hdrBlocks = (hdr.frames + bs - 1) / bs;
+        if (!entropy && nBlocks < hdrBlocks) {
+            cerr << "Encoded file truncated\n";
+            return 1;
+        }
+        nBlocks = hdrBlocks;
+    }
     if (nBlocks == 0) { cerr << "No blocks inferred\n"; return 1; }
-    uint64_t numSamples = static_cast<uint64_t>(nBlocks) * bs;
+
+    // Frames startFrame .. endFrame - 1 a descodificar, pedidos por tempo
+    // (--from/--to) ou por blocos (-b/-nb); só os blocos que os contêm são lidos
+    uint64_t totalFrames = static_cast<uint64_t>(nBlocks) * bs;
+    if (has_header) totalFrames = min<uint64_t>(totalFrames, hdr.frames);
+    uint64_t startFrame, endFrame;
+    if (fromSec >= 0 || toSec >= 0) {
+        startFrame = fromSec > 0 ? static_cast<uint64_t>(llround(fromSec * sample_rate)) : 0;
+        endFrame = toSec >= 0 ? min<uint64_t>(totalFrames, llround(toSec * sample_rate)) : totalFrames;
+    } else {
+        startFrame = static_cast<uint64_t>(firstBlock) * bs;
+        endFrame = numBlocksReq != 0 ? min<uint64_t>(totalFrames, (firstBlock + numBlocksReq) * bs) : totalFrames;
+    }
+    if (startFrame >= totalFrames) { cerr << "Start past the end of the file\n"; return 1; }
+    if (startFrame >= endFrame) { cerr << "Empty range\n"; return 1; }
+    firstBlock = static_cast<size_t>(startFrame / bs);
+    const size_t lastBlock = static_cast<size_t>((endFrame + bs - 1) / bs);
+    const uint64_t numSamples = endFrame - startFrame; // frames
 
     cout << "Inferred keep_sz=" << keep_sz << " nBlocks=" << nBlocks << " numSamples=" << numSamples << "\n";
     
+    // Leitura sequencial (não mapeada), para a memória usada não depender do
+    // tamanho do ficheiro
+    ifs_enc.clear();
+    ifs_enc.seekg(header_bytes);
     BitStream ibs(ifs_enc, STREAM_READ);
 
+    // Índice de blocos: no fim do ficheiro (trailer) ou, nos ficheiros mais
+    // antigos, em <input>.idx
+    vector<BitCheckpoint> index;
+    if (firstBlock != 0 && !read_bit_index_trailer(in_path, index))
+        read_bit_index(in_path + ".idx", index);
+
+    // Saltar para o primeiro bloco: pelo índice, se tiver esse bloco, senão
+    // pela posição calculada (todos os blocos têm rec * n_bits bits). No modo
+    // entrópico os blocos têm tamanho variável: os blocos desde o checkpoint
+    // anterior (ou o início) são lidos e descartados
+    size_t skipBlocks = 0;
+    if (firstBlock != 0 && !lanes) {
+        uint64_t bitPos = entropy ? 0 : static_cast<uint64_t>(firstBlock) * rec_bits;
+        size_t posBlock = entropy ? 0 : firstBlock;
+        const BitCheckpoint* cp = find_checkpoint(index, firstBlock);
+        if (cp != nullptr && (cp->block == firstBlock || entropy)) {
+            bitPos = cp->bit;
+            posBlock = cp->block;
+        }
+        skipBlocks = firstBlock - posBlock;
+        if (!ibs.seek_bit(bitPos)) {
+            cerr << "Cannot seek to block " << firstBlock << "\n";
+            return 1;
+        }
+        cout << "Starting at block " << firstBlock << " (bit " << bitPos << ")\n";
+    }
+
     ofstream ofs(out_path, ios::out | ios::binary);
     if (!ofs.is_open()) {
         cerr << "Error opening output WAV: " << out_path << "\n";
@@ -110,86 +256,241 @@ int main(int argc, char* argv[]) {
     }
 
     // Write simple WAV header (PCM)
-
-    uint16_t audio_format = 1; // PCM
-    uint16_t num_channels = static_cast<uint16_t>(channels);
-    uint32_t sample_rate_u = static_cast<uint32_t>(sample_rate);
-    uint16_t bits_per_sample = static_cast<uint16_t>(orig_bits);
-    uint16_t block_align = num_channels * (bits_per_sample / 8);
-    uint32_t byte_rate = sample_rate_u * block_align;
-    uint32_t subchunk2_size = static_cast<uint32_t>(numSamples * block_align);
-    uint32_t chunk_size = 36 + subchunk2_size;
-
-    ofs.write("RIFF", 4);
-    write_little_endian(ofs, chunk_size, 4);
-    ofs.write("WAVE", 4);
-    ofs.write("fmt ", 4);
-    write_little_endian(ofs, 16, 4); // subchunk1 size PCM
-    write_little_endian(ofs, audio_format, 2);
-    write_little_endian(ofs, num_channels, 2);
-    write_little_endian(ofs, sample_rate_u, 4);
-    write_little_endian(ofs, byte_rate, 4);
-    write_little_endian(ofs, block_align, 2);
-    write_little_endian(ofs, bits_per_sample, 2);
-    ofs.write("data", 4);
-    write_little_endian(ofs, subchunk2_size, 4);
-
-    vector<double> X(bs, 0.0), x(bs, 0.0);
-    fftw_plan plan_i = fftw_plan_r2r_1d(static_cast<int>(bs), X.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
-    if (!plan_i) {
-        cerr << "FFTW plan creation failed\n";
-        return 1;
+    write_wav_header(ofs, static_cast<uint16_t>(channels), static_cast<uint32_t>(sample_rate),
+                     static_cast<uint16_t>(orig_bits), numSamples);
+
+    // Cada worker (ou lane) tem os seus buffers e o seu plano FFTW (criados
+    // aqui: o planeamento não é thread-safe, a execução com planos diferentes é).
+    // Os planos vêm da wisdom guardada, se existir (dct_plan.h). A IDCT é
+    // feita K blocos de cada vez: as linhas da matriz X (bloco j, canal c
+    // na linha j * channels + c) passam todas por um só plano
+    const size_t K = k_blocks > 0 ? k_blocks : dct_batch_blocks(static_cast<int>(bs), channels);
+    const size_t rows = K * channels;
+    // Com -float cada worker usa o motor em precisão simples e não há planos
+    if (use_float && !DctFloat::supports(static_cast<int>(bs))) {
+        cerr << "Sem IDCT em float para blocos de " << bs << " pontos, a usar o FFTW\n";
+        use_float = false;
     }
+    if (use_float)
+        cout << "IDCT em float (" << DctFloat::kernel_name() << ")\n";
+    DctPlanner planner;
+    struct Worker {
+        DctVector X, x;
+        vector<uint16_t> q;
+        fftw_plan plan = nullptr;
+        unique_ptr<DctFloat> fdct;
+    };
+    auto make_workers = [&](size_t n) {
+        vector<Worker> workers(n);
+        for (Worker& w : workers) {
+            w.X.assign(rows * bs, 0.0);
+            w.x.assign(rows * bs, 0.0);
+            w.q.resize(rec);
+            if (use_float)
+                w.fdct = make_unique<DctFloat>(static_cast<int>(bs), static_cast<int>(rows), true);
+            else
+                w.plan = planner.plan_many_r2r(static_cast<int>(bs), static_cast<int>(rows), w.X.data(), w.x.data(), FFTW_REDFT01);
+        }
+        return workers;
+    };
+
+    BitUnpackFn unpack = bit_unpack_fn(n_bits);
+
+    // Lê os rec coeficientes de um bloco de "in" e desquantiza-os para v
+    // (valores normalizados). No modo fixo os coeficientes são lidos de uma
+    // vez pelo kernel de n_bits fixos (larguras > 16 usam read_n_bits); no
+    // entrópico, banda a banda. Devolve false se o ficheiro acabar antes
+    auto read_block = [&](BitStream& in, double* v, vector<uint16_t>& qBlock, bool debug) {
+        uint32_t z[DCTE_BAND];
+        for (size_t r = 0; entropy && r < static_cast<size_t>(channels); ++r) {
+            for (size_t i = 0; i < nBands; ++i) {
+                size_t k0 = i * DCTE_BAND, n = min<size_t>(DCTE_BAND, keep_sz - k0);
+                double step;
+                if (!dcte_read_band(in, delta, z, n, &step))
+                    return false;
+                for (size_t k = 0; k < n; ++k) {
+                    v[r * keep_sz + k0 + k] = dcte_unzigzag(z[k]) * step;
+                    if (debug && first_qs.size() < SHOW_N) first_qs.push_back(z[k]);
+                }
+            }
+        }
 
-
-
-    // Decode: iterate TODOS os blocos (sem /2)
-    for (size_t b = 0; b < nBlocks; ++b) {
-        for (size_t k = 0; k < keep_sz; ++k) {
-
-            // read quantized value
-
-            uint64_t q = ibs.read_n_bits(n_bits);
-
-            // dequantize
-            if (q >= q_levels) q = q_levels - 1;
-            X[k] = (static_cast<double>(q) / (q_levels-1) * 2.0 - 1.0) * static_cast<double>(bs);
-                    
-            coeffs_read++;
-            if (first_qs.size() < SHOW_N) first_qs.push_back(q);
-                    
+        if (!entropy) {
+            if (unpack != nullptr)
+                unpack(in, qBlock);
+
+            for (size_t k = 0; k < rec; ++k) {
+                // dequantize
+                uint64_t qk = unpack != nullptr ? qBlock[k] : in.read_n_bits(n_bits);
+                if (debug && first_qs.size() < SHOW_N) first_qs.push_back(qk);
+                if (qk >= q_levels) qk = q_levels - 1;
+                v[k] = static_cast<double>(qk) / (q_levels-1) * 2.0 - 1.0;
+            }
         }
 
-        // zero remaining coefficients
-        for (size_t k = keep_sz; k < bs; ++k) X[k] = 0.0;
+        if (debug) coeffs_read += rec;
+        return true;
+    };
+
+    // Frames do bloco b reconstruídas (o último pode ser parcial)
+    auto block_frames = [&](size_t b) {
+        return static_cast<size_t>(min<uint64_t>(bs, endFrame - static_cast<uint64_t>(b) * bs));
+    };
+
+    // Escreve as frames dos blocos first .. last - 1 (em pcm) que estão no intervalo pedido
+    auto write_pcm = [&](const vector<int16_t>& pcm, size_t first, size_t last) {
+        uint64_t from = max<uint64_t>(static_cast<uint64_t>(first) * bs, startFrame);
+        uint64_t to = min<uint64_t>(static_cast<uint64_t>(last) * bs, endFrame);
+        ofs.write(reinterpret_cast<const char*>(pcm.data() + (from - static_cast<uint64_t>(first) * bs) * channels),
+                  (to - from) * channels * sizeof(int16_t));
+    };
+
+    // Reconstrói os nb (<= K) blocos b0, b0 + step, ... cujos coeficientes
+    // desquantizados estão seguidos em v: copia-os para a matriz X, aplica a
+    // IDCT com o plano do worker e escreve as amostras intercaladas de cada
+    // bloco b em pcm, a partir do bloco pcm_block
+    auto synth_blocks = [&](const double* v, size_t nb, size_t b0, size_t step, Worker& w,
+                            int16_t* pcm, size_t pcm_block) {
+        for (size_t r = 0; r < nb * channels; ++r) {
+            double* X = w.X.data() + r * bs;
+            for (size_t k = 0; k < keep_sz; ++k)
+                X[k] = v[r * keep_sz + k] * static_cast<double>(bs);
+
+            // zero remaining coefficients
+            for (size_t k = keep_sz; k < bs; ++k) X[k] = 0.0;
+        }
 
 
         // IDCT
-        fftw_execute(plan_i);
-
-        /*
-        if (b == 0) {
-            ofstream csv("reconstructed_block.csv");
-            for (size_t n = 0; n < bs; ++n)
-                csv << x[n] << "\n";
-            csv.close();
+        if (w.fdct)
+            w.fdct->execute(w.X.data(), w.x.data());
+        else
+            fftw_execute(w.plan);
+
+        // Escala para int16
+        for (size_t j = 0; j < nb; ++j) {
+            const size_t b = b0 + j * step;
+            int16_t* out = pcm + (b - pcm_block) * bs * channels;
+            const double* x = w.x.data() + j * channels * bs;
+            const size_t frames = block_frames(b);
+            for (size_t n = 0; n < frames; ++n) {
+                for (int c = 0; c < channels; ++c) {
+                    // Normaliza para [-1.0, +1.0]
+                    double sample_val = (x[c * bs + n] / (2.0 * bs)) * 32768.0;
+                    if (sample_val > 32767) sample_val = 32767;
+                    if (sample_val < -32768) sample_val = -32768;
+
+                    // Arredonda para o inteiro mais próximo
+                    out[n * channels + c] = static_cast<int16_t>(lround(sample_val));
+                }
+            }
+        }
+    };
+
+    if (lanes) {
+        // Lote a lote, cada lane descodifica os seus blocos do lote na sua
+        // thread, com o seu worker, para o buffer PCM do lote, que é depois
+        // escrito de uma vez
+        const size_t N = lanes->n_lanes();
+        vector<Worker> workers = make_workers(N);
+
+        // Cada lane começa no seu primeiro bloco do intervalo e avança por
+        // ordem; no modo entrópico a lane salta para o seu último checkpoint
+        // até esse bloco e os blocos seguintes são lidos e descartados (têm
+        // tamanho variável)
+        vector<double> skip(entropy ? rec : 0);
+        for (size_t l = 0; l < N; ++l) {
+            size_t b = firstBlock + (l + N - firstBlock % N) % N;
+            bool ok = true;
+            if (entropy && b < lastBlock) {
+                const BitCheckpoint* cp = find_checkpoint(index, b);
+                while (cp != nullptr && cp->block % N != l)
+                    cp = cp == index.data() ? nullptr : cp - 1;
+                if (cp != nullptr)
+                    ok = lanes->lane(l).seek_bit(cp->bit);
+                for (size_t s = (cp != nullptr ? cp->block : l); s < b && ok; s += N)
+                    ok = read_block(lanes->lane(l), skip.data(), workers[l].q, false);
+            } else if (b < lastBlock)
+                ok = lanes->lane(l).seek_bit(static_cast<uint64_t>(b / N) * rec_bits);
+            if (b < lastBlock && !ok) {
+                cerr << "Cannot seek to block " << b << "\n";
+                return 1;
+            }
         }
-            */
 
+        const size_t BATCH_BLOCKS = 4 * K * N;
+        vector<int16_t> pcm(min(BATCH_BLOCKS, lastBlock - firstBlock) * bs * channels);
+        atomic<bool> truncated { false };
+        for (size_t first = firstBlock; first < lastBlock; first += BATCH_BLOCKS) {
+            const size_t last = min(lastBlock, first + BATCH_BLOCKS);
+            lanes->for_each_lane([&](int l, BitStream& lane) {
+                size_t b = first + (l + N - first % N) % N; // primeiro bloco desta lane no lote
+
+                vector<double> v(K * rec);
+                while (b < last) {
+                    size_t nb = 0;
+                    for ( ; nb < K && b + nb * N < last; ++nb)
+                        if (!read_block(lane, v.data() + nb * rec, workers[l].q, false))
+                            truncated = true;
+                    synth_blocks(v.data(), nb, b, N, workers[l], pcm.data(), first);
+                    b += nb * N;
+                }
+            });
+            if (truncated) {
+                cerr << "Encoded file truncated\n";
+                return 1;
+            }
+
+            write_pcm(pcm, first, last);
+        }
 
-        // Escala para int16
-        for (size_t n = 0; n < bs; ++n) {
-            // Normaliza para [-1.0, +1.0]
-            double sample_val = (x[n] / (2.0 * bs)) * 32768.0;
-            if (sample_val > 32767) sample_val = 32767;
-            if (sample_val < -32768) sample_val = -32768;
-
-            // Arredonda para o inteiro mais próximo
-            int16_t out_s = static_cast<int16_t>(lround(sample_val));
-            ofs.write(reinterpret_cast<char*>(&out_s), sizeof(out_s));
+        for (Worker& w : workers)
+            if (w.plan) fftw_destroy_plan(w.plan);
+        coeffs_read = static_cast<uint64_t>(lastBlock - firstBlock) * rec;
+    } else {
+        // Os coeficientes de cada lote de blocos são lidos por ordem; a IDCT
+        // é distribuída pelos workers (o próximo grupo de K blocos vai para o
+        // primeiro worker livre) e o lote é escrito de uma vez. O tamanho do
+        // lote vem de um orçamento fixo de memória para os seus buffers (e
+        // não do número de threads), arredondado a grupos de K blocos
+        vector<Worker> workers = make_workers(n_threads);
+        const size_t BATCH_BYTES = 8 << 20;
+        const size_t blockBytes = rec * sizeof(double) + bs * channels * sizeof(int16_t);
+        const size_t BATCH_BLOCKS = max<size_t>(1, BATCH_BYTES / blockBytes / K) * K;
+        const size_t batch = min(BATCH_BLOCKS, lastBlock - firstBlock);
+        vector<double> vBatch(batch * rec);
+        vector<int16_t> pcm(batch * bs * channels);
+        for (size_t b = firstBlock - skipBlocks; b < firstBlock; ++b)
+            if (!read_block(ibs, vBatch.data(), workers[0].q, false)) {
+                cerr << "Cannot seek to block " << firstBlock << "\n";
+                return 1;
+            }
+        for (size_t first = firstBlock; first < lastBlock; first += BATCH_BLOCKS) {
+            const size_t last = min(lastBlock, first + BATCH_BLOCKS);
+            for (size_t b = first; b < last; ++b)
+                if (!read_block(ibs, vBatch.data() + (b - first) * rec, workers[0].q, true)) {
+                    cerr << "Encoded file truncated at block " << b << "\n";
+                    return 1;
+                }
+
+            atomic<size_t> next { first };
+            auto work = [&](Worker& w) {
+                for (size_t b = next.fetch_add(K); b < last; b = next.fetch_add(K))
+                    synth_blocks(vBatch.data() + (b - first) * rec, min(K, last - b), b, 1, w, pcm.data(), first);
+            };
+
+            vector<thread> pool;
+            for (int t = 1; t < n_threads; ++t)
+                pool.emplace_back(work, ref(workers[t]));
+            work(workers[0]);
+            for (thread& t : pool)
+                t.join();
+
+            write_pcm(pcm, first, last);
         }
 
-        
+        for (Worker& w : workers)
+            if (w.plan) fftw_destroy_plan(w.plan);
     }
 
     // print debug info
@@ -200,10 +501,13 @@ int main(int argc, char* argv[]) {
     }
     if (first_qs.size() % 8 != 0) cout << "\n";
 
+    // Um erro de leitura não é o fim do ficheiro
+    if (ibs.failed()) {
+        cerr << "Error reading " << in_path << "\n";
+        return 1;
+    }
 
-    fftw_destroy_plan(plan_i);
     ibs.close();
-    ifs_enc.close();
     ofs.close();
 
     cout << "Decoded WAV written to: " << out_path << "  (frames = " << numSamples << ")\n";
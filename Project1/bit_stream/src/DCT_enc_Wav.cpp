@@ -1,5 +1,11 @@
 // wav_quant_enc_fixed.cpp
 #include "bit_stream.h"
+#include "bit_lanes.h"
+#include "wav_file.h"
+#include "dct_header.h"
+#include "dct_plan.h"
+#include "dct_entropy.h"
+#include "dct_float.h"
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -7,145 +13,323 @@
 #include <fftw3.h>
 #include <iomanip>
 #include <cstdint>
-#include <cstring>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 using namespace std;
 
-static uint16_t read_u16_le(ifstream &ifs) {
-    uint8_t b0,b1; ifs.read(reinterpret_cast<char*>(&b0),1); ifs.read(reinterpret_cast<char*>(&b1),1);
-    return static_cast<uint16_t>(b0 | (b1<<8));
-}
-static uint32_t read_u32_le(ifstream &ifs) {
-    uint8_t b0,b1,b2,b3; ifs.read(reinterpret_cast<char*>(&b0),1); ifs.read(reinterpret_cast<char*>(&b1),1);
-    ifs.read(reinterpret_cast<char*>(&b2),1); ifs.read(reinterpret_cast<char*>(&b3),1);
-    return static_cast<uint32_t>(b0 | (b1<<8) | (b2<<16) | (b3<<24));
-}
-
 int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        cerr << "Usage: " << argv[0] << " <input.wav> <output.enc> <bits> <DCT_frac>" << endl;
+    // Treino único da wisdom do FFTW (dct_plan.h), usada depois por todas as execuções
+    if (int status = dct_train_wisdom_option(argc, argv); status >= 0)
+        return status;
+
+    if (argc < 5) {
+        cerr << "Usage: " << argv[0] << " <input.wav> <output.enc> <bits> <DCT_frac> [ -lanes N ] [ -t threads ] [ -k K ] [ -e precision ] [ -float ]" << endl;
+        cerr << "       " << argv[0] << " --train-wisdom [ blockSize ... ]" << endl;
         return 1;
     }
 
     const size_t bs = 1024;
     const double dctFrac = stod(argv[4]);
     const int n_bits = stoi(argv[3]);
-    const uint32_t q_levels = 1u << n_bits;
+    // O cabeçalho DCT2 aceita 1 a 32 bits, e cada bloco guarda no máximo os
+    // seus bs coeficientes
+    if (n_bits < 1 || n_bits > 32) {
+        cerr << "n_bits must be between 1 and 32\n";
+        return 1;
+    }
+    if (!(dctFrac > 0 && dctFrac <= 1) || floor(bs * dctFrac) < 1) {
+        cerr << "DCT_frac must be in (0, 1] and keep at least one coefficient\n";
+        return 1;
+    }
+    const uint64_t q_levels = 1ULL << n_bits;
     const size_t keep_sz = static_cast<size_t>(floor(bs * dctFrac));
 
+    // Modo multi-lane (-lanes N): o bloco b vai para a lane b % N, e o
+    // descodificador lê as lanes em paralelo
+    int n_lanes = 0;
+    // Número de workers (-t N): por omissão, um por core
+    int n_threads = max(1u, thread::hardware_concurrency());
+    // Blocos por DCT em lote (-k K): por omissão, o que cabe na cache L2
+    int k_blocks = 0;
+    // Modo entrópico (-e P): passos por banda com P bits de precisão
+    // (0 = passo fixo) e códigos Golomb-Rice (dct_entropy.h)
+    bool entropy = false;
+    int precision = 0;
+    for (int n = 5; n < argc - 1; n++) {
+        if (string(argv[n]) == "-lanes") n_lanes = stoi(argv[n+1]);
+        if (string(argv[n]) == "-t") n_threads = max(1, stoi(argv[n+1]));
+        if (string(argv[n]) == "-k") k_blocks = max(1, stoi(argv[n+1]));
+        if (string(argv[n]) == "-e") { entropy = true; precision = max(0, stoi(argv[n+1])); }
+    }
+    // DCT em float (-float) com o motor de dct_float.h em vez do FFTW
+    bool use_float = false;
+    for (int n = 5; n < argc; n++)
+        if (string(argv[n]) == "-float") use_float = true;
+    // O cabeçalho guarda o número de lanes em 16 bits
+    if (n_lanes < 0 || n_lanes > UINT16_MAX) {
+        cerr << "-lanes must be between 0 and " << UINT16_MAX << "\n";
+        return 1;
+    }
+    if (entropy && (n_bits < 1 || n_bits > DCTE_MAX_BITS)) {
+        cerr << "n_bits must be between 1 and " << DCTE_MAX_BITS << " with -e\n";
+        return 1;
+    }
+
 
-    ifstream inputFile_Wav(argv[1], ios::in | ios::binary);
+    WavStream wav(argv[1]);
     fstream outputFile_Enc(argv[2], ios::out | ios::binary);
 
-    if (!inputFile_Wav.is_open() || !outputFile_Enc.is_open()) {
+    if (!wav.is_open()) {
+        cerr << "Error reading " << argv[1] << ": " << wav.error() << endl;
+        return 1;
+    }
+    if (!outputFile_Enc.is_open()) {
         cerr << "Error opening files" << endl;
         return 1;
     }
 
-    // --- HEADER ESCRITA --- Para identificar o keep_sz e bs na decodificação
-
-    uint32_t magic = 0x44435431; // "DCT1" em ASCII
-    uint16_t header_bs = static_cast<uint16_t>(bs);
-    uint16_t header_keep = static_cast<uint16_t>(keep_sz);
-
-    outputFile_Enc.write(reinterpret_cast<char*>(&magic), sizeof(magic));
-    outputFile_Enc.write(reinterpret_cast<char*>(&header_bs), sizeof(header_bs));
-    outputFile_Enc.write(reinterpret_cast<char*>(&header_keep), sizeof(header_keep));
-
-    // Lê header WAV simples (assume PCM)
-    inputFile_Wav.seekg(0, ios::beg);
-    char riff[4]; inputFile_Wav.read(riff,4);
-    if (strncmp(riff,"RIFF",4) != 0) { cerr << "Not a RIFF file\n"; return 1; }
-
-    inputFile_Wav.seekg(22, ios::beg); 
-    uint16_t numChannels = read_u16_le(inputFile_Wav); 
-    inputFile_Wav.seekg(24, ios::beg); 
-    uint32_t sampleRate = read_u32_le(inputFile_Wav); 
-    inputFile_Wav.seekg(34, ios::beg);
-    uint16_t bitsPerSample = read_u16_le(inputFile_Wav);
-
-    // assume data chunk starts at 44 (simples)
-    inputFile_Wav.seekg(0, ios::end);
-    uint64_t fileSize = static_cast<uint64_t>(inputFile_Wav.tellg());
-    uint64_t dataSize = fileSize - 44; 
-    inputFile_Wav.seekg(44, ios::beg);
+    // Parâmetros do WAV: o WavStream percorre os chunks RIFF (LIST, fact,
+    // EXTENSIBLE, RF64) e depois lê as amostras por ordem, lote a lote, para
+    // a memória usada não depender da duração do ficheiro
+    const WavInfo& info = wav.info();
+    uint16_t numChannels = info.channels;
+    uint32_t sampleRate = info.sample_rate;
+    uint16_t bitsPerSample = info.bits_per_sample;
+    uint64_t dataSize = info.data_size;
 
     cout << "WAV channels=" << numChannels << " sampleRate=" << sampleRate << " bitsPerSample=" << bitsPerSample << "\n";
     cout << "num_bits=" << n_bits << " q_levels=" << q_levels << "\n";
     cout << "dataSize = " << dataSize << " bytes\n";
     cout << "bs = " << bs << " keep_sz = " << keep_sz << " (frac=" << dctFrac << ")\n";
-    cout << "File size = " << fileSize << " bytes\n";
 
-    if (bitsPerSample != 16) { cerr << "Only 16-bit PCM supported\n"; return 1; }
+    if (info.format != WAV_FORMAT_PCM || bitsPerSample != 16) { cerr << "Only 16-bit PCM supported\n"; return 1; }
 
-    uint64_t nFrames = dataSize / (numChannels * 2); // F2
+    uint64_t nFrames = info.frames; // F2
     cout << "nFrames = " << nFrames << endl;
 
-    // Ler todos os samples (assume 16 bits PCM)
-    // 1 Frame (2 Bytes por canal) = numChannels * 2 bytes
-    // 1 Sample = 2 bytes (16 bits)
-
-    vector<int16_t> samples(static_cast<size_t>(nFrames * numChannels));
-    for (uint64_t f = 0; f < nFrames; ++f) {
-        for (uint16_t ch = 0; ch < numChannels; ++ch) {
-            int16_t s = 0;
-            inputFile_Wav.read(reinterpret_cast<char*>(&s), sizeof(int16_t));
-            samples[static_cast<size_t>(f) * numChannels + ch] = s;
-            //printf("Sample[%llu][%u] = %d\n", f, ch, s);
-        }
-    }
-
     // nBlocks com arredondamento para cima
     size_t nBlocks = (nFrames + bs - 1) / bs; // F1
     cout << "nBlocks = " << nBlocks << endl;
     if (nBlocks == 0) { cerr << "File too short\n"; return 1; }
 
-    BitStream obs(outputFile_Enc, STREAM_WRITE); // BitStream para escrita de bits
-
-    vector<double> x(bs);
-    vector<double> X(bs);
-    fftw_plan plan_d = fftw_plan_r2r_1d(static_cast<int>(bs), x.data(), X.data(), FFTW_REDFT10, FFTW_ESTIMATE);
-
-    cout << "keep_sz = " << keep_sz << "\n";
-
-    uint64_t coeffs_written = 0; // Contador de coeficientes escritos
+    const size_t K = k_blocks > 0 ? k_blocks : dct_batch_blocks(static_cast<int>(bs), numChannels);
+
+    // --- HEADER ESCRITA --- Tudo o que o descodificador precisa (dct_header.h)
+    DctHeader hdr;
+    hdr.bs = static_cast<uint16_t>(bs);
+    hdr.keep_sz = static_cast<uint16_t>(keep_sz);
+    hdr.channels = numChannels;
+    hdr.n_bits = static_cast<uint16_t>(n_bits);
+    hdr.sample_rate = sampleRate;
+    hdr.orig_bits = bitsPerSample;
+    hdr.n_lanes = static_cast<uint16_t>(n_lanes);
+    hdr.frames = nFrames;
+    hdr.entropy = entropy;
+    if (!hdr.write(outputFile_Enc)) {
+        cerr << "Error writing " << argv[2] << endl;
+        return 1;
+    }
 
-    // coder: bloco a bloco com zero-padding
-    for (size_t b = 0; b < nBlocks; ++b) {
+    unique_ptr<BitLaneWriter> lanes;
+    unique_ptr<BitStream> obs_file;
+    if (n_lanes > 0)
+        lanes = make_unique<BitLaneWriter>(n_lanes);
+    else {
+        // O BitStream abre o ficheiro por caminho a seguir ao cabeçalho (e
+        // pode então usar io_uring); escrita assíncrona, 4 buffers
+        const off_t header_bytes = outputFile_Enc.tellp();
+        outputFile_Enc.close();
+        obs_file = make_unique<BitStream>(argv[2], STREAM_WRITE, header_bytes, 4);
+        if (!obs_file->is_open()) {
+            cerr << "Error opening files" << endl;
+            return 1;
+        }
+    }
 
-        // Preencher x com os samples do bloco b, canal 0, ou zeros se for padding
+    // Cada worker tem os seus buffers e o seu plano FFTW (criados aqui: o
+    // planeamento não é thread-safe, a execução com planos diferentes é).
+    // Os planos vêm da wisdom guardada, se existir (dct_plan.h). A DCT é
+    // feita K blocos de cada vez: as linhas da matriz x (bloco j, canal c
+    // na linha j * numChannels + c) passam todas por um só plano. Com
+    // -float cada worker usa o motor em precisão simples e não há planos
+    struct Worker {
+        DctVector x, X;
+        fftw_plan plan = nullptr;
+        unique_ptr<DctFloat> fdct;
+    };
+    const size_t rows = K * numChannels;
+    DctPlanner planner;
+    vector<Worker> workers(n_threads);
+    for (Worker& w : workers) {
+        w.x.resize(rows * bs);
+        w.X.resize(rows * bs);
+        if (use_float)
+            w.fdct = make_unique<DctFloat>(static_cast<int>(bs), static_cast<int>(rows), false);
+        else
+            w.plan = planner.plan_many_r2r(static_cast<int>(bs), static_cast<int>(rows), w.x.data(), w.X.data(), FFTW_REDFT10);
+    }
 
-        for (size_t k = 0; k < bs; ++k) {
-            uint64_t frameIdx = b*bs + k; // índice do frame global // F3
-            if (frameIdx >= nFrames) {
-                x[k] = 0.0; // padding final
-            } else {
-                size_t idx = frameIdx*numChannels + 0; // apenas canal 0
-                x[k] = static_cast<double>(samples[idx]) / 32768.0; // normaliza para [-1.0, +1.0]
+    cout << "keep_sz = " << keep_sz << " channels = " << numChannels << " threads = " << n_threads << " K = " << K
+         << (use_float ? string(" DCT float (") + DctFloat::kernel_name() + ")" : string()) << "\n";
+
+    // Um checkpoint no índice a cada INDEX_STRIDE blocos (de cada lane): no
+    // máximo INDEX_STRIDE - 1 blocos lidos e descartados ao saltar
+    const size_t INDEX_STRIDE = 16;
+
+    // Um bloco ocupa, canal a canal, keep_sz coeficientes quantizados; no
+    // modo entrópico cada canal tem também os parâmetros das suas bandas
+    const size_t rec = keep_sz * numChannels;
+    const size_t nBands = (keep_sz + DCTE_BAND - 1) / DCTE_BAND;
+    const double delta = dcte_delta(n_bits);
+
+    // Janela com os samples do lote atual: frames winFirst .. winEnd - 1
+    // (os que faltarem no fim do ficheiro são padding)
+    vector<int16_t> window;
+    uint64_t winFirst = 0, winEnd = 0;
+
+    // Codifica os nb (<= K) blocos a partir de b0 (todos os canais) com o
+    // worker w para q[0 .. nb * rec - 1] (e, no modo entrópico, os
+    // parâmetros das bandas para bands[0 .. nb * numChannels * nBands - 1])
+    auto encode_blocks = [&](Worker& w, size_t b0, size_t nb, uint32_t* q, DcteBand* bands) {
+
+        // Preencher x com os samples dos blocos, canal a canal, ou zeros se for padding
+
+        for (size_t j = 0; j < nb; ++j) {
+            double* row = w.x.data() + j * numChannels * bs;
+            for (size_t k = 0; k < bs; ++k) {
+                uint64_t frameIdx = (b0 + j)*bs + k; // índice do frame global // F3
+                for (size_t c = 0; c < numChannels; ++c) {
+                    if (frameIdx >= winEnd) {
+                        row[c * bs + k] = 0.0; // padding final
+                    } else {
+                        size_t idx = (frameIdx - winFirst)*numChannels + c; // na janela
+                        row[c * bs + k] = static_cast<double>(window[idx]) / 32768.0; // normaliza para [-1.0, +1.0]
+                    }
+                }
             }
         }
 
-        fftw_execute(plan_d);
+        if (w.fdct)
+            w.fdct->execute(w.x.data(), w.X.data());
+        else
+            fftw_execute(w.plan);
 
         // Ajuste da DCT-II para IDCT-III compatível
 
-        for (size_t k = 0; k < keep_sz; ++k) {
-            double val = X[k] / bs; // normalização
-            // Quantização uniforme em [0 .. q_levels-1]
+        for (size_t r = 0; r < nb * numChannels; ++r) {
+            double* X = w.X.data() + r * bs;
+            if (entropy) {
+                // Quantização por bandas, centrada em zero, em zig-zag
+                for (size_t k = 0; k < keep_sz; ++k)
+                    X[k] /= bs; // normalização
+                for (size_t i = 0; i < nBands; ++i) {
+                    size_t k0 = i * DCTE_BAND, n = min<size_t>(DCTE_BAND, keep_sz - k0);
+                    bands[r * nBands + i] = dcte_quantize_band(X + k0, n, delta, precision, q + r * keep_sz + k0);
+                }
+                continue;
+            }
+            for (size_t k = 0; k < keep_sz; ++k) {
+                double val = X[k] / bs; // normalização
+                // Quantização uniforme em [0 .. q_levels-1]
 
-            int q = static_cast<int>(round((val + 1.0) / 2.0 * (q_levels - 1)));
-            q = max(0, min(q, static_cast<int>(q_levels - 1)));
+                int64_t qk = static_cast<int64_t>(round((val + 1.0) / 2.0 * (q_levels - 1)));
+                q[r * keep_sz + k] = static_cast<uint32_t>(max<int64_t>(0, min<int64_t>(qk, q_levels - 1)));
+            }
+        }
+    };
+
+    uint64_t coeffs_written = 0; // Contador de coeficientes escritos
 
-            //double fk = k * (44100.0 / static_cast<double>(bs)); // frequência aproximada
-            //printf("Block %zu Coeff %zu: freq=%.2f Hz  DCT val=%.6f Quant=%d\n", b, k, fk, val, q);
-            obs.write_n_bits(static_cast<uint64_t>(q), n_bits);
-            coeffs_written++;
+    // Coeficientes quantizados de um bloco, escritos de uma vez pelo kernel de
+    // n_bits fixos (escolhido uma só vez; larguras > 16 usam write_n_bits)
+    vector<uint16_t> qBlock(rec);
+    BitPackFn pack = bit_pack_fn(n_bits);
+
+    // coder: os grupos de K blocos de cada lote são distribuídos pelos
+    // workers (o próximo grupo livre vai para o primeiro worker livre) e os
+    // blocos são depois escritos por ordem. O tamanho do lote vem de um
+    // orçamento fixo de memória para os seus buffers (e não do número de
+    // threads), arredondado a grupos de K blocos
+    const size_t BATCH_BYTES = 8 << 20;
+    const size_t blockBytes = bs * numChannels * sizeof(int16_t) + rec * sizeof(uint32_t)
+                              + (entropy ? numChannels * nBands * sizeof(DcteBand) : 0);
+    const size_t BATCH_BLOCKS = max<size_t>(1, BATCH_BYTES / blockBytes / K) * K;
+    vector<uint32_t> qBatch(min(BATCH_BLOCKS, nBlocks) * rec);
+    vector<DcteBand> bandBatch(entropy ? min(BATCH_BLOCKS, nBlocks) * numChannels * nBands : 0);
+    window.resize(min(BATCH_BLOCKS, nBlocks) * bs * numChannels);
+    for (size_t first = 0; first < nBlocks; first += BATCH_BLOCKS) {
+        const size_t last = min(nBlocks, first + BATCH_BLOCKS);
+
+        // Samples intercalados do lote (16 bits PCM): 1 Frame = numChannels samples
+        winFirst = static_cast<uint64_t>(first) * bs;
+        winEnd = winFirst + wav.read_frames(window.data(), (last - first) * bs);
+        atomic<size_t> next { first };
+        auto work = [&](Worker& w) {
+            for (size_t b = next.fetch_add(K); b < last; b = next.fetch_add(K))
+                encode_blocks(w, b, min(K, last - b), qBatch.data() + (b - first) * rec,
+                              bandBatch.data() + (b - first) * numChannels * nBands);
+        };
+
+        vector<thread> pool;
+        for (int t = 1; t < n_threads; ++t)
+            pool.emplace_back(work, ref(workers[t]));
+        work(workers[0]);
+        for (thread& t : pool)
+            t.join();
+
+        for (size_t b = first; b < last; ++b) {
+            BitStream& obs = lanes ? lanes->lane(b % n_lanes) : *obs_file;
+            if ((lanes ? b / n_lanes : b) % INDEX_STRIDE == 0)
+                obs.checkpoint(b); // posição (em bits, na sua lane) do início do bloco b, para o índice
+
+            const uint32_t* q = qBatch.data() + (b - first) * rec;
+            if (entropy) {
+                // Blocos de tamanho variável: escritos pela ordem, banda a banda
+                const DcteBand* bands = bandBatch.data() + (b - first) * numChannels * nBands;
+                for (size_t c = 0; c < numChannels; ++c)
+                    for (size_t i = 0; i < nBands; ++i) {
+                        size_t k0 = i * DCTE_BAND;
+                        dcte_write_band(obs, bands[c * nBands + i], q + c * keep_sz + k0, min<size_t>(DCTE_BAND, keep_sz - k0));
+                    }
+            } else if (pack != nullptr) {
+                copy(q, q + rec, qBlock.begin());
+                pack(obs, qBlock);
+            } else {
+                for (size_t k = 0; k < rec; ++k)
+                    obs.write_n_bits(q[k], n_bits);
+            }
+            coeffs_written += rec;
         }
     }
 
-    fftw_destroy_plan(plan_d);
-    obs.close();
-    inputFile_Wav.close();
+    for (Worker& w : workers)
+        if (w.plan) fftw_destroy_plan(w.plan);
+
+    // Índice de blocos no fim do ficheiro (trailer, bit_index.h), para o
+    // descodificador saltar diretamente para o primeiro bloco pedido
+    vector<BitCheckpoint> index;
+    if (lanes) {
+        for (int l = 0; l < n_lanes; ++l)
+            index.insert(index.end(), lanes->lane(l).checkpoints().begin(), lanes->lane(l).checkpoints().end());
+        sort(index.begin(), index.end(), [](const BitCheckpoint& a, const BitCheckpoint& b) { return a.block < b.block; });
+        lanes->write(outputFile_Enc);
+    } else {
+        obs_file->close(); // é reaberto para acrescentar o índice
+        if (obs_file->failed()) {
+            cerr << "Error writing " << argv[2] << endl;
+            return 1;
+        }
+        index = obs_file->checkpoints();
+        outputFile_Enc.open(argv[2], ios::in | ios::out | ios::binary | ios::ate);
+    }
+
+    if (!write_bit_index_trailer(outputFile_Enc, index)) {
+        cerr << "Error writing the block index of " << argv[2] << endl;
+        return 1;
+    }
     outputFile_Enc.close();
 
     cout << "coeffs_written = " << coeffs_written << "\n";
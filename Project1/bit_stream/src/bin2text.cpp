@@ -18,10 +18,14 @@
 //
 #include <iostream>
 #include <fstream>
-#include "bit_stream.h"
+#include <vector>
+#include "byte_stream.h"
+#include "bit_text.h"
 
 using namespace std;
 
+constexpr size_t BIN_BLOCK_SIZE = 1 << 16; // Bytes converted per block
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char* argv[]) {
@@ -31,8 +35,8 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	fstream ifs { argv[argc-2], ios::in | ios::binary };
-	if(not ifs.is_open()) {
+	ByteStream ibs { string(argv[argc-2]) };
+	if(not ibs.is_open()) {
 		cerr << "Error opening text file " << argv[argc-2] << endl;
 		return 1;
 	}
@@ -43,18 +47,17 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	BitStream ibs { ifs, STREAM_READ };
+	vector<uint8_t> bin(BIN_BLOCK_SIZE);
+	vector<char> text(8 * BIN_BLOCK_SIZE);
+	size_t n;
+	while((n = ibs.read(bin.data(), bin.size())) != 0) {
+		bits_to_text(bin.data(), n, text.data());
+		ofs.write(text.data(), 8 * n);
+	}
 
-	int c;
-	while((c = ibs.read_bit()) != EOF) {
-		switch(c) {
-			case 0:
-				ofs << "0";
-				break;
-			case 1:
-				ofs << "1";
-				break;
-		}
+	if(ibs.failed()) {
+		cerr << "Error reading bin file " << argv[argc-2] << endl;
+		return 1;
 	}
 
 	ofs << "\n";
@@ -0,0 +1,209 @@
+//------------------------------------------------------------------------------
+//
+// Throughput benchmark of the BitStream word engine (and of the fixed-width
+// pack/unpack kernels) against the former bit-by-bit implementation, kept
+// here verbatim as LegacyBitStream. All write the same random fields, the
+// resulting files must be identical, and all are read back and checked.
+//
+//------------------------------------------------------------------------------
+//
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include "bit_stream.h"
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+
+class LegacyBitStream {
+  private:
+	bool		m_rw_status;
+	int			m_buf;
+	int			m_bit_ptr;
+	ByteStream	m_byte_stream;
+
+  public:
+	LegacyBitStream(fstream& fs, bool rw_status) : m_rw_status { rw_status },
+	  m_byte_stream { fs, rw_status } {
+		if(rw_status) {
+			m_bit_ptr = -1;
+		} else {
+			m_bit_ptr = 7;
+			m_buf = 0;
+		}
+	}
+
+	int read_bit() {
+		if(--m_bit_ptr < 0) {
+			if((m_buf = m_byte_stream.get()) == EOF)
+				return EOF;
+
+			m_bit_ptr = 7;
+		}
+
+		return (m_buf & (0x01 << m_bit_ptr)) >> m_bit_ptr;
+	}
+
+	uint64_t read_n_bits(int n) {
+		uint64_t x { };
+		for(int i = 0 ; i < n ; ++i) {
+			x <<= 1;
+			x |= read_bit();
+		}
+
+		return x;
+	}
+
+	void write_bit(int bit) {
+		if(m_bit_ptr < 0) {
+			m_byte_stream.put(m_buf);
+			m_bit_ptr = 7;
+			m_buf = 0;
+		}
+
+		m_buf |= (bit & 0x01) << m_bit_ptr--;
+	}
+
+	void write_n_bits(uint64_t bits, int n) {
+		for(int i = n - 1 ; i >= 0 ; i--)
+			write_bit(((0x01 << i) & bits) >> i);
+	}
+
+	void close() {
+		if(not m_rw_status) {
+			if(m_bit_ptr != 7)
+				m_byte_stream.put(m_buf);
+		}
+
+		m_byte_stream.close();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+template<typename Stream>
+static double time_write(const string& path, const vector<uint64_t>& values, int n_bits) {
+	fstream fs { path, ios::out | ios::binary };
+	Stream obs { fs, STREAM_WRITE };
+	auto t0 = chrono::steady_clock::now();
+	for(uint64_t v : values)
+		obs.write_n_bits(v, n_bits);
+
+	obs.close();
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+template<typename Stream>
+static double time_read(const string& path, const vector<uint64_t>& values, int n_bits, bool& ok) {
+	fstream fs { path, ios::in | ios::binary };
+	Stream ibs { fs, STREAM_READ };
+	auto t0 = chrono::steady_clock::now();
+	for(uint64_t v : values)
+		if(ibs.read_n_bits(n_bits) != v)
+			ok = false;
+
+	ibs.close();
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+static double time_pack(const string& path, const vector<uint16_t>& values, int n_bits) {
+	fstream fs { path, ios::out | ios::binary };
+	BitStream obs { fs, STREAM_WRITE };
+	BitPackFn pack = bit_pack_fn(n_bits);
+	auto t0 = chrono::steady_clock::now();
+	pack(obs, values);
+	obs.close();
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+static double time_unpack(const string& path, const vector<uint16_t>& values, int n_bits, bool& ok) {
+	vector<uint16_t> out(values.size());
+	fstream fs { path, ios::in | ios::binary };
+	BitStream ibs { fs, STREAM_READ };
+	BitUnpackFn unpack = bit_unpack_fn(n_bits);
+	auto t0 = chrono::steady_clock::now();
+	unpack(ibs, out);
+	double t = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	if(out != values)
+		ok = false;
+
+	ibs.close();
+	return t;
+}
+
+static bool same_file(const string& a, const string& b) {
+	ifstream fa { a, ios::binary }, fb { b, ios::binary };
+	return vector<char>(istreambuf_iterator<char>(fa), {}) == vector<char>(istreambuf_iterator<char>(fb), {});
+}
+
+int main(int argc, char* argv[]) {
+
+	size_t n_values { 4000000 };
+	string dir { "/tmp" };
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-n" and n + 1 < argc)
+			n_values = stoul(argv[n+1]);
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-dir" and n + 1 < argc)
+			dir = argv[n+1];
+
+	string legacy_path { dir + "/bit_bench_legacy.bin" };
+	string word_path { dir + "/bit_bench_word.bin" };
+	string pack_path { dir + "/bit_bench_pack.bin" };
+
+	mt19937_64 rng { 2025 };
+	bool all_ok { true };
+
+	cout << "bits  path     write MB/s  write ns/bit  read MB/s  read ns/bit\n";
+	for(int n_bits : { 1, 3, 8, 12, 16, 32 }) {
+		vector<uint64_t> values(n_values);
+		for(auto& v : values)
+			v = rng() & ((uint64_t { 1 } << n_bits) - 1);
+
+		double total_bits = static_cast<double>(n_values) * n_bits;
+		bool ok { true };
+
+		double tw_legacy = time_write<LegacyBitStream>(legacy_path, values, n_bits);
+		double tr_legacy = time_read<LegacyBitStream>(legacy_path, values, n_bits, ok);
+		double tw_word = time_write<BitStream>(word_path, values, n_bits);
+		double tr_word = time_read<BitStream>(word_path, values, n_bits, ok);
+
+		if(not same_file(legacy_path, word_path))
+			ok = false;
+
+		auto report = [&](const char* name, double tw, double tr) {
+			printf("%4d  %-7s  %10.1f  %12.3f  %9.1f  %11.3f\n", n_bits, name,
+			  total_bits / 8 / tw / 1e6, tw * 1e9 / total_bits,
+			  total_bits / 8 / tr / 1e6, tr * 1e9 / total_bits);
+		};
+		report("legacy", tw_legacy, tr_legacy);
+		report("word", tw_word, tr_word);
+
+		if(n_bits <= 16) { // Fixed-width bulk kernels
+			vector<uint16_t> values16(values.begin(), values.end());
+			double tw_pack = time_pack(pack_path, values16, n_bits);
+			double tr_pack = time_unpack(pack_path, values16, n_bits, ok);
+			if(not same_file(legacy_path, pack_path))
+				ok = false;
+
+			report("pack", tw_pack, tr_pack);
+		}
+
+		if(not ok) {
+			cerr << "Error: outputs differ for " << n_bits << " bits\n";
+			all_ok = false;
+		}
+	}
+
+	remove(legacy_path.c_str());
+	remove(word_path.c_str());
+	remove(pack_path.c_str());
+	return all_ok ? 0 : 1;
+}
+
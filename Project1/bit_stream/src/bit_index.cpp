@@ -0,0 +1,124 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <algorithm>
+#include "bit_index.h"
+
+using namespace std;
+
+//-------------------------------------------------------------------------------------------
+
+static bool write_index(ostream& os, const vector<BitCheckpoint>& index) {
+	uint64_t count = index.size();
+	os.write((char*)&BIT_INDEX_MAGIC, sizeof(BIT_INDEX_MAGIC));
+	os.write((char*)&count, sizeof(count));
+	os.write((char*)index.data(), count * sizeof(BitCheckpoint));
+	return bool(os);
+}
+
+// Fails, without allocating, if there are more than "max_count" entries
+static bool read_index(istream& is, vector<BitCheckpoint>& index, uint64_t max_count = UINT64_MAX) {
+	uint32_t magic { };
+	uint64_t count { };
+	is.read((char*)&magic, sizeof(magic));
+	is.read((char*)&count, sizeof(count));
+	if(not is or magic != BIT_INDEX_MAGIC or count > max_count)
+		return false;
+
+	index.resize(count);
+	is.read((char*)index.data(), count * sizeof(BitCheckpoint));
+	return bool(is);
+}
+
+//-------------------------------------------------------------------------------------------
+
+bool write_bit_index(const string& path, const vector<BitCheckpoint>& index) {
+	ofstream ofs { path, ios::out | ios::binary };
+	if(not ofs.is_open())
+		return false;
+
+	return write_index(ofs, index);
+}
+
+//-------------------------------------------------------------------------------------------
+
+bool read_bit_index(const string& path, vector<BitCheckpoint>& index) {
+	ifstream ifs { path, ios::in | ios::binary };
+	if(not ifs.is_open())
+		return false;
+
+	return read_index(ifs, index);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Appends the index and its footer at the current (end) position of "os"
+//
+bool write_bit_index_trailer(ostream& os, const vector<BitCheckpoint>& index) {
+	uint64_t offset = os.tellp();
+	if(not write_index(os, index))
+		return false;
+
+	os.write((char*)&offset, sizeof(offset));
+	os.write((char*)&BIT_INDEX_TRAILER_MAGIC, sizeof(BIT_INDEX_TRAILER_MAGIC));
+	return bool(os);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Loads the trailer of "path"; false if the file does not end with one
+//
+bool read_bit_index_trailer(const string& path, vector<BitCheckpoint>& index) {
+	ifstream ifs { path, ios::in | ios::binary };
+	const off_t footer = sizeof(uint64_t) + sizeof(uint32_t);
+	if(not ifs.is_open() or not ifs.seekg(-footer, ios::end))
+		return false;
+
+	off_t size = off_t(ifs.tellg()) + footer;
+	uint64_t offset { };
+	uint32_t magic { };
+	ifs.read((char*)&offset, sizeof(offset));
+	ifs.read((char*)&magic, sizeof(magic));
+	const uint64_t head = sizeof(uint32_t) + sizeof(uint64_t);
+	if(not ifs or magic != BIT_INDEX_TRAILER_MAGIC or offset + head > uint64_t(size - footer))
+		return false;
+
+	// The entries must fill the space up to the footer exactly
+	uint64_t n_bytes = uint64_t(size - footer) - offset - head;
+	ifs.seekg(offset);
+	if(n_bytes % sizeof(BitCheckpoint) != 0 or not read_index(ifs, index, n_bytes / sizeof(BitCheckpoint))
+	  or index.size() != n_bytes / sizeof(BitCheckpoint)) {
+		index.clear();
+		return false;
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Last checkpoint at or before "block" (nullptr if there is none)
+//
+const BitCheckpoint* find_checkpoint(const vector<BitCheckpoint>& index, uint64_t block) {
+	auto it = upper_bound(index.begin(), index.end(), block,
+	  [](uint64_t b, const BitCheckpoint& cp) { return b < cp.block; });
+
+	return it == index.begin() ? nullptr : &*(it - 1);
+}
+
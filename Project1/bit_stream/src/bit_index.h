@@ -0,0 +1,56 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef BIT_INDEX_H
+#define BIT_INDEX_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+//-------------------------------------------------------------------------------------------
+//
+// Checkpoint index of a BitStream: the bit offset (BitStream::tell_bit()) at
+// which each recorded block starts. Writers collect checkpoints with
+// BitStream::checkpoint() and save them in a sidecar file; readers load it
+// and BitStream::seek_bit() to the block they need.
+//
+// Sidecar layout (little-endian): "BIDX", uint64 count, count x (uint64
+// block, uint64 bit offset), blocks in increasing order.
+//
+// The same index can instead be appended to the stream file itself, as a
+// trailer: the sidecar layout followed by a footer with the byte offset of
+// "BIDX" (uint64) and "BIDT", so that readers find it from the end of the file.
+//
+struct BitCheckpoint {
+	uint64_t	block;
+	uint64_t	bit;
+};
+
+const uint32_t BIT_INDEX_MAGIC = 0x58444942; // "BIDX"
+const uint32_t BIT_INDEX_TRAILER_MAGIC = 0x54444942; // "BIDT"
+
+bool write_bit_index(const std::string& path, const std::vector<BitCheckpoint>& index);
+bool read_bit_index(const std::string& path, std::vector<BitCheckpoint>& index);
+bool write_bit_index_trailer(std::ostream& os, const std::vector<BitCheckpoint>& index);
+bool read_bit_index_trailer(const std::string& path, std::vector<BitCheckpoint>& index);
+const BitCheckpoint* find_checkpoint(const std::vector<BitCheckpoint>& index, uint64_t block);
+
+#endif
+
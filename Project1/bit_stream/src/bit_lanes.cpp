@@ -0,0 +1,157 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bit_lanes.h"
+
+using namespace std;
+
+BitLaneWriter::BitLaneWriter(int n_lanes) : m_data(n_lanes) {
+	for(auto& data : m_data)
+		m_lanes.push_back(make_unique<BitStream>(data));
+}
+
+int BitLaneWriter::n_lanes() const {
+	return m_lanes.size();
+}
+
+BitStream& BitLaneWriter::lane(int l) {
+	return *m_lanes[l];
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Closes the lanes and writes the container at the current position of fs
+//
+bool BitLaneWriter::write(fstream& fs) {
+	vector<uint64_t> bits;
+	for(auto& lane : m_lanes) {
+		bits.push_back(lane->tell_bit());
+		lane->close();
+	}
+
+	uint32_t magic { BIT_LANES_MAGIC };
+	uint32_t n { static_cast<uint32_t>(m_lanes.size()) };
+	fs.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+	fs.write(reinterpret_cast<const char*>(&n), sizeof(n));
+	fs.write(reinterpret_cast<const char*>(bits.data()), n * sizeof(uint64_t));
+	for(const auto& data : m_data)
+		fs.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	return fs.good();
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Opens the container that starts at byte "offset" of the file "path". The
+// file is mapped or, if that fails (e.g. a pipe), read into memory
+//
+BitLaneReader::BitLaneReader(const string& path, off_t offset) {
+	const uint8_t* data { };
+	size_t size { };
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		struct stat st;
+		if(fstat(fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > offset) {
+			void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED) {
+				m_map = static_cast<uint8_t*>(map);
+				m_map_size = st.st_size;
+				data = m_map + offset;
+				size = m_map_size - offset;
+			}
+		}
+
+		::close(fd);
+	}
+
+	if(m_map == nullptr) {
+		ifstream ifs { path, ios::binary };
+		if(offset != 0)
+			ifs.seekg(offset);
+
+		m_own_data.assign(istreambuf_iterator<char>(ifs), { });
+		data = m_own_data.data();
+		size = m_own_data.size();
+	}
+
+	uint32_t magic { }, n { };
+	if(size < 2 * sizeof(uint32_t))
+		return;
+
+	memcpy(&magic, data, sizeof(magic));
+	memcpy(&n, data + sizeof(magic), sizeof(n));
+	size_t pos = 2 * sizeof(uint32_t) + n * sizeof(uint64_t);
+	if(magic != BIT_LANES_MAGIC or n == 0 or pos > size)
+		return;
+
+	m_bits.resize(n);
+	memcpy(m_bits.data(), data + 2 * sizeof(uint32_t), n * sizeof(uint64_t));
+	for(uint64_t bits : m_bits) {
+		size_t n_bytes = (bits + 7) / 8;
+		if(n_bytes > size - pos) { // Truncated file
+			m_lanes.clear();
+			return;
+		}
+
+		m_lanes.push_back(make_unique<BitStream>(span<const uint8_t>(data + pos, n_bytes)));
+		pos += n_bytes;
+	}
+}
+
+BitLaneReader::~BitLaneReader() {
+	m_lanes.clear();
+	if(m_map != nullptr)
+		munmap(m_map, m_map_size);
+}
+
+bool BitLaneReader::is_open() const {
+	return not m_lanes.empty();
+}
+
+int BitLaneReader::n_lanes() const {
+	return m_lanes.size();
+}
+
+uint64_t BitLaneReader::lane_bits(int l) const {
+	return m_bits[l];
+}
+
+BitStream& BitLaneReader::lane(int l) {
+	return *m_lanes[l];
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Calls f(l, lane(l)) for every lane, each on its own thread
+//
+void BitLaneReader::for_each_lane(const function<void(int, BitStream&)>& f) {
+	vector<thread> threads;
+	for(int l = 1 ; l < n_lanes() ; l++)
+		threads.emplace_back(f, l, ref(lane(l)));
+
+	f(0, lane(0));
+	for(auto& t : threads)
+		t.join();
+}
@@ -0,0 +1,78 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef BIT_LANES_H
+#define BIT_LANES_H
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "bit_stream.h"
+
+//-------------------------------------------------------------------------------------------
+//
+// Multi-lane container: N independent bit streams (lanes) in one file, so
+// that they can be decoded at the same time. The writer fills each lane in
+// memory; the reader gives each lane its own BitStream over one mapping of
+// the file. How values are split among lanes (e.g. block b in lane b % N) is
+// up to the codec.
+//
+// Layout (little-endian): "LANE", uint32 N, N x uint64 lane length in bits,
+// then the lanes, each padded to a whole byte.
+//
+const uint32_t BIT_LANES_MAGIC = 0x454e414c; // "LANE"
+
+class BitLaneWriter {
+  private:
+	std::vector<std::vector<uint8_t>>		m_data;
+	std::vector<std::unique_ptr<BitStream>>	m_lanes;
+
+  public:
+	BitLaneWriter(int n_lanes);
+
+	int n_lanes() const;
+	BitStream& lane(int l);
+	bool write(std::fstream& fs);
+};
+
+class BitLaneReader {
+  private:
+	uint8_t*								m_map { };
+	size_t									m_map_size { };
+	std::vector<uint8_t>					m_own_data; // When the file cannot be mapped
+	std::vector<uint64_t>					m_bits;
+	std::vector<std::unique_ptr<BitStream>>	m_lanes;
+
+  public:
+	BitLaneReader(const std::string& path, off_t offset = 0);
+	~BitLaneReader();
+
+	BitLaneReader(const BitLaneReader&) = delete;
+	BitLaneReader& operator=(const BitLaneReader&) = delete;
+
+	bool is_open() const;
+	int n_lanes() const;
+	uint64_t lane_bits(int l) const;
+	BitStream& lane(int l);
+	void for_each_lane(const std::function<void(int, BitStream&)>& f);
+};
+
+#endif
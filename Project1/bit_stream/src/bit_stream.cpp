@@ -17,85 +17,495 @@
 //-------------------------------------------------------------------------------------------
 
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <array>
+#include <utility>
 #include "bit_stream.h"
 
 using namespace std;
 
-BitStream::BitStream(fstream& fs, bool rw_status) : m_rw_status { rw_status },
-  m_byte_stream { fs, rw_status } {
-	if(rw_status) {
-		m_bit_ptr = -1;
-	} else {
-		m_bit_ptr = 7;
-		m_buf = 0;
-	}
+BitStream::BitStream(fstream& fs, bool rw_status, int n_async_buffers) : m_rw_status { rw_status },
+  m_byte_stream { fs, rw_status, n_async_buffers } {
+}
+
+BitStream::BitStream(const string& path, off_t offset) : m_rw_status { STREAM_READ },
+  m_byte_stream { path, offset } {
+}
+
+BitStream::BitStream(const string& path, bool rw_status, off_t offset, int n_async_buffers) :
+  m_rw_status { rw_status }, m_byte_stream { path, rw_status, offset, n_async_buffers } {
+}
+
+BitStream::BitStream(vector<uint8_t>& buf) : m_rw_status { STREAM_WRITE },
+  m_byte_stream { buf } {
+}
+
+BitStream::BitStream(span<const uint8_t> data) : m_rw_status { STREAM_READ },
+  m_byte_stream { data } {
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Tops up the read accumulator with as many whole bytes as fit in it. The
+// bytes are loaded as one big-endian word, so the first byte of the stream
+// ends up in the most significant free position
+//
+void BitStream::refill() {
+	uint8_t bytes[8];
+	size_t n_bytes = m_byte_stream.read(bytes, (64 - m_acc_bits) >> 3);
+	if(n_bytes == 0)
+		return;
+
+	uint64_t word { };
+	memcpy(&word, bytes, n_bytes);
+	m_acc |= __builtin_bswap64(word) >> m_acc_bits;
+	m_acc_bits += 8 * n_bytes;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Sends the (full) write accumulator to the byte stream, most significant byte first
+//
+void BitStream::flush_word() {
+	uint64_t word { __builtin_bswap64(m_acc) };
+	m_byte_stream.write(reinterpret_cast<uint8_t*>(&word), 8);
+	m_acc = 0;
+	m_acc_bits = 0;
 }
 
 int BitStream::read_bit() {
-	if(--m_bit_ptr < 0) {
-		if((m_buf = m_byte_stream.get()) == EOF)
+	if(m_acc_bits == 0) {
+		refill();
+		if(m_acc_bits == 0)
 			return EOF;
-
-		m_bit_ptr = 7;
 	}
 
-	return (m_buf & (0x01 << m_bit_ptr)) >> m_bit_ptr;
+	int bit = m_acc >> 63;
+	m_acc <<= 1;
+	m_acc_bits--;
+	return bit;
 }
 
-uint64_t BitStream::read_n_bits(int n) {
-	uint64_t x { };
-	for(int i = 0 ; i < n ; ++i) {
-		x <<= 1;
-		x |= read_bit();
+//-------------------------------------------------------------------------------------------
+//
+// Reads n (<= 64) bits when the accumulator does not hold enough of them. As
+// with the former bit-by-bit implementation, a read that runs past the end of
+// the stream returns all ones (EOF)
+//
+uint64_t BitStream::read_n_bits_slow(int n) {
+	if(n <= 0)
+		return 0;
+
+	if(n > 56) { // A refill only guarantees 57 bits: split long reads in two
+		uint64_t hi = read_n_bits(n - 32);
+		uint64_t lo = read_n_bits(32);
+		if(hi == static_cast<uint64_t>(EOF) or lo == static_cast<uint64_t>(EOF))
+			return static_cast<uint64_t>(EOF);
+
+		return (hi << 32) | lo;
+	}
+
+	if(m_acc_bits < n) {
+		refill();
+		if(m_acc_bits < n) {
+			m_acc = 0;
+			m_acc_bits = 0;
+			return static_cast<uint64_t>(EOF);
+		}
 	}
 
+	uint64_t x = m_acc >> (64 - n);
+	m_acc <<= n;
+	m_acc_bits -= n;
 	return x;
 }
 
+//-------------------------------------------------------------------------------------------
+//
+// Reads up to the next newline (or the end of the stream). When byte aligned,
+// the accumulator is emptied and the rest is scanned in the byte buffer.
+// Otherwise the accumulator is searched for the newline a word at a time
+//
 string BitStream::read_string() {
-	int c;
 	string s;
 
-	while((c = read_n_bits(8)) != '\n')
-		s += c;
+	if((m_acc_bits & 7) == 0) {
+		for( ; m_acc_bits != 0 ; m_acc <<= 8, m_acc_bits -= 8) {
+			char c = m_acc >> 56;
+			if(c == '\n') {
+				m_acc <<= 8;
+				m_acc_bits -= 8;
+				return s;
+			}
+
+			s += c;
+		}
+
+		m_byte_stream.read_until('\n', s);
+		return s;
+	}
+
+	const uint64_t low7 { 0x7f7f7f7f7f7f7f7f };
+	for(;;) {
+		if(m_acc_bits < 8) {
+			refill();
+			if(m_acc_bits < 8) {
+				m_acc = 0;
+				m_acc_bits = 0;
+				return s;
+			}
+		}
+
+		// Only the whole bytes count: a high 0x80 marks each newline among them
+		int n_bytes = m_acc_bits >> 3;
+		uint64_t x = m_acc ^ 0x0a0a0a0a0a0a0a0a;
+		uint64_t nl = ~(((x & low7) + low7) | x | low7);
+		if(n_bytes < 8)
+			nl &= ~(~uint64_t { } >> (8 * n_bytes));
+
+		int n_copy = nl == 0 ? n_bytes : __builtin_clzll(nl) >> 3;
+		for(int i = 0 ; i < n_copy ; i++)
+			s += static_cast<char>(m_acc >> (56 - 8 * i));
 
-	return s;
+		int n_used = nl == 0 ? n_bytes : n_copy + 1;
+		m_acc = n_used == 8 ? 0 : m_acc << (8 * n_used);
+		m_acc_bits -= 8 * n_used;
+		if(nl != 0)
+			return s;
+	}
 }
 
-void BitStream::write_bit(int bit) {
-	if(m_bit_ptr < 0) {
-		m_byte_stream.put(m_buf);
-		m_bit_ptr = 7;
-		m_buf = 0;
+//-------------------------------------------------------------------------------------------
+//
+// Reads n bytes, returning how many there were before the end of the stream.
+// The whole bytes in the accumulator go first. The rest is copied straight
+// from the byte stream and, when not byte aligned, shifted into place a word
+// at a time, with the r leftover bits carried from word to word and finally
+// kept in the accumulator
+//
+size_t BitStream::read_bytes(uint8_t* data, size_t n) {
+	size_t k { };
+	for( ; k < n and m_acc_bits >= 8 ; k++) {
+		data[k] = m_acc >> 56;
+		m_acc <<= 8;
+		m_acc_bits -= 8;
+	}
+
+	if(k == n)
+		return n;
+
+	size_t n_read = m_byte_stream.read(data + k, n - k);
+	int r = m_acc_bits;
+	if(r == 0)
+		return k + n_read;
+
+	uint64_t carry = m_acc >> (64 - r);
+	uint64_t mask = (uint64_t { 1 } << r) - 1;
+	uint8_t* p = data + k;
+	uint8_t* end = p + n_read;
+	for( ; end - p >= 8 ; p += 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		w = __builtin_bswap64(w);
+		uint64_t out = __builtin_bswap64((carry << (64 - r)) | (w >> r));
+		memcpy(p, &out, 8);
+		carry = w & mask;
 	}
 
-	m_buf |= (bit & 0x01) << m_bit_ptr--;
+	for( ; p != end ; p++) {
+		uint8_t b = *p;
+		*p = (carry << (8 - r)) | (b >> r);
+		carry = b & mask;
+	}
+
+	m_acc = carry << (64 - r);
+	return k + n_read;
 }
 
-void BitStream::write_n_bits(uint64_t bits, int n) {
-	for(int i = n - 1 ; i >= 0 ; i--)
-		write_bit(((0x01 << i) & bits) >> i);
+void BitStream::write_bit(int bit) {
+	m_acc = (m_acc << 1) | (bit & 0x01);
+	if(++m_acc_bits == 64)
+		flush_word();
 }
 
-void BitStream::write_string(const string& s) {
-	for(const char c : s)
-		write_n_bits(c, 8);
+//-------------------------------------------------------------------------------------------
+//
+// Writes n (<= 64) bits when they fill the accumulator
+//
+void BitStream::write_n_bits_slow(uint64_t bits, int n) {
+	if(n <= 0)
+		return;
+
+	if(n < 64)
+		bits &= (uint64_t { 1 } << n) - 1;
+
+	int n_free = 64 - m_acc_bits;
+	if(n < n_free) { // Fits in the accumulator with room to spare
+		m_acc = (m_acc << n) | bits;
+		m_acc_bits += n;
+		return;
+	}
+
+	// Complete the current word with the high part of bits and emit it
+	int n_spill = n - n_free;
+	m_acc = n_free == 64 ? bits >> n_spill : (m_acc << n_free) | (bits >> n_spill);
+	m_acc_bits = 64;
+	flush_word();
+
+	if(n_spill != 0) {
+		m_acc = bits & ((uint64_t { 1 } << n_spill) - 1);
+		m_acc_bits = n_spill;
+	}
+}
 
+void BitStream::write_string(const string& s) {
+	write_bytes(reinterpret_cast<const uint8_t*>(s.data()), s.size());
 	write_n_bits('\n', 8); // Mark the end of the string with a newline
 }
 
+//-------------------------------------------------------------------------------------------
+//
+// Writes n bytes. The whole bytes in the accumulator are sent first; when
+// byte aligned, the data then goes straight to the byte stream. Otherwise
+// it is shifted by the r leftover bits a word at a time, through a staging
+// buffer, and the last r bits stay in the accumulator
+//
+void BitStream::write_bytes(const uint8_t* data, size_t n) {
+	int n_whole = m_acc_bits >> 3;
+	int r = m_acc_bits & 7;
+	if(n_whole != 0) {
+		uint64_t word { __builtin_bswap64(m_acc << (64 - m_acc_bits)) };
+		m_byte_stream.write(reinterpret_cast<uint8_t*>(&word), n_whole);
+		m_acc &= (uint64_t { 1 } << r) - 1;
+		m_acc_bits = r;
+	}
+
+	if(r == 0)
+		return m_byte_stream.write(data, n);
+
+	uint64_t carry = m_acc;
+	uint64_t mask = (uint64_t { 1 } << r) - 1;
+	uint8_t staging[4096];
+	while(n != 0) {
+		size_t n_chunk = n < sizeof(staging) ? n : sizeof(staging);
+		size_t i { };
+		for( ; n_chunk - i >= 8 ; i += 8) {
+			uint64_t w;
+			memcpy(&w, data + i, 8);
+			w = __builtin_bswap64(w);
+			uint64_t out = __builtin_bswap64((carry << (64 - r)) | (w >> r));
+			memcpy(staging + i, &out, 8);
+			carry = w & mask;
+		}
+
+		for( ; i != n_chunk ; i++) {
+			staging[i] = (carry << (8 - r)) | (data[i] >> r);
+			carry = data[i] & mask;
+		}
+
+		m_byte_stream.write(staging, n_chunk);
+		data += n_chunk;
+		n -= n_chunk;
+	}
+
+	m_acc = carry;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Variable-length codes. Unary codes n as n zeros followed by a one; it is
+// decoded by counting the leading zeros of the read accumulator, a whole
+// word of zeros at a time. Reads past the end of the stream return EOF
+//
+uint64_t BitStream::read_unary() {
+	uint64_t n { };
+	for(;;) {
+		if(m_acc_bits == 0) {
+			refill();
+			if(m_acc_bits == 0)
+				return static_cast<uint64_t>(EOF);
+		}
+
+		// Bits below m_acc_bits are always zero, hence the explicit limit
+		int n_zeros = m_acc == 0 ? 64 : __builtin_clzll(m_acc);
+		if(n_zeros < m_acc_bits) {
+			m_acc <<= n_zeros; // Two shifts, as n_zeros + 1 may be 64
+			m_acc <<= 1;
+			m_acc_bits -= n_zeros + 1;
+			return n + n_zeros;
+		}
+
+		n += m_acc_bits;
+		m_acc = 0;
+		m_acc_bits = 0;
+	}
+}
+
+void BitStream::write_unary(uint64_t n) {
+	for( ; n >= 56 ; n -= 56)
+		write_n_bits(0, 56);
+
+	write_n_bits(1, n + 1);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Elias-gamma codes v >= 1 as floor(log2 v) in unary followed by the bits of
+// v below its leading one. There is no code for 0: writing it fails, and
+// nothing is written
+//
+uint64_t BitStream::read_elias_gamma() {
+	uint64_t n = read_unary();
+	if(n > 63)
+		return static_cast<uint64_t>(EOF);
+
+	if(n == 0)
+		return 1;
+
+	uint64_t low = read_n_bits(n);
+	if(low == static_cast<uint64_t>(EOF))
+		return static_cast<uint64_t>(EOF);
+
+	return (uint64_t { 1 } << n) | low;
+}
+
+bool BitStream::write_elias_gamma(uint64_t v) {
+	if(v == 0)
+		return false;
+
+	int n = 63 - __builtin_clzll(v);
+	write_unary(n);
+	write_n_bits(v, n);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Exp-Golomb of order k codes v >= 0 as the Elias-gamma code of v + 2^k with
+// its first k zeros dropped. Small k suits values clustered around zero
+//
+uint64_t BitStream::read_exp_golomb(int k) {
+	uint64_t n = read_unary();
+	if(n > static_cast<uint64_t>(63 - k))
+		return static_cast<uint64_t>(EOF);
+
+	int n_bits = static_cast<int>(n) + k;
+	uint64_t low { };
+	if(n_bits != 0 and (low = read_n_bits(n_bits)) == static_cast<uint64_t>(EOF))
+		return static_cast<uint64_t>(EOF);
+
+	return ((uint64_t { 1 } << n_bits) | low) - (uint64_t { 1 } << k);
+}
+
+void BitStream::write_exp_golomb(int k, uint64_t v) {
+	uint64_t w = v + (uint64_t { 1 } << k);
+	int n_bits = 63 - __builtin_clzll(w);
+	write_unary(n_bits - k);
+	write_n_bits(w, n_bits);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Number of whole bytes produced (writing) or consumed (reading) so far
+//
 off_t BitStream::tell() {
-	return m_byte_stream.tell();
+	if(m_rw_status)
+		return m_byte_stream.tell() - (m_acc_bits >> 3);
+
+	return m_byte_stream.tell() + (m_acc_bits >> 3);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Number of bits produced (writing) or consumed (reading) so far
+//
+uint64_t BitStream::tell_bit() {
+	if(m_rw_status)
+		return 8 * static_cast<uint64_t>(m_byte_stream.tell()) - m_acc_bits;
+
+	return 8 * static_cast<uint64_t>(m_byte_stream.tell()) + m_acc_bits;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Moves a reader to bit "pos" of the stream. Returns false if the stream
+// cannot seek there (writers, pipes, positions past the end)
+//
+bool BitStream::seek_bit(uint64_t pos) {
+	if(not m_rw_status or not m_byte_stream.seek(pos >> 3))
+		return false;
+
+	m_acc = 0;
+	m_acc_bits = 0;
+	return (pos & 7) == 0 or read_n_bits(pos & 7) != static_cast<uint64_t>(EOF);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Records that block "block" starts at the current bit position
+//
+void BitStream::checkpoint(uint64_t block) {
+	m_checkpoints.push_back({ block, tell_bit() });
+}
+
+const vector<BitCheckpoint>& BitStream::checkpoints() const {
+	return m_checkpoints;
+}
+
+bool BitStream::is_open() const {
+	return m_byte_stream.is_open();
+}
+
+bool BitStream::failed() const {
+	return m_byte_stream.failed();
 }
 
 void BitStream::close() {
 	if(not m_rw_status) {
-		if(m_bit_ptr != 7) // Flush the bit buffer only if there are some bits there
-			m_byte_stream.put(m_buf);
+		if(m_acc_bits != 0) { // Flush the bit buffer only if there are some bits there
+			int n_bytes = (m_acc_bits + 7) >> 3;
+			uint64_t word { __builtin_bswap64(m_acc << (64 - m_acc_bits)) };
+			m_byte_stream.write(reinterpret_cast<uint8_t*>(&word), n_bytes);
+			m_acc = 0;
+			m_acc_bits = 0;
+		}
 	}
 
 	m_byte_stream.close(); // Calls byte_stream flush if needed
 }
 
+//-------------------------------------------------------------------------------------------
+
+template<int N>
+static void pack_n(BitStream& bs, span<const uint16_t> values) {
+	bs.pack<N>(values);
+}
+
+template<int N>
+static void unpack_n(BitStream& bs, span<uint16_t> values) {
+	bs.unpack<N>(values);
+}
+
+template<int... N>
+static constexpr array<BitPackFn, sizeof...(N)> make_pack_table(integer_sequence<int, N...>) {
+	return { pack_n<N + 1>... };
+}
+
+template<int... N>
+static constexpr array<BitUnpackFn, sizeof...(N)> make_unpack_table(integer_sequence<int, N...>) {
+	return { unpack_n<N + 1>... };
+}
+
+static constexpr auto pack_table { make_pack_table(make_integer_sequence<int, 16> { }) };
+static constexpr auto unpack_table { make_unpack_table(make_integer_sequence<int, 16> { }) };
+
+BitPackFn bit_pack_fn(int n_bits) {
+	return n_bits >= 1 and n_bits <= 16 ? pack_table[n_bits - 1] : nullptr;
+}
+
+BitUnpackFn bit_unpack_fn(int n_bits) {
+	return n_bits >= 1 and n_bits <= 16 ? unpack_table[n_bits - 1] : nullptr;
+}
+
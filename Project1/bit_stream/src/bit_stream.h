@@ -21,17 +21,41 @@
 
 #include <string>
 #include <fstream>
+#include <cstdint>
+#include <vector>
+#include <span>
 #include "byte_stream.h"
+#include "bit_index.h"
 
+//-------------------------------------------------------------------------------------------
+//
+// Bits are packed MSB first through a 64-bit accumulator. When writing, m_acc
+// holds the last m_acc_bits bits written (right-aligned) and is handed to the
+// ByteStream one full word at a time. When reading, m_acc holds the next
+// m_acc_bits bits of the stream (left-aligned) and is refilled a word at a time.
+//
 class BitStream {
   private:
 	bool		m_rw_status { STREAM_READ };
-	int			m_buf;
-	int			m_bit_ptr;
+	uint64_t	m_acc { };
+	int			m_acc_bits { };
 	ByteStream	m_byte_stream;
+	std::vector<BitCheckpoint> m_checkpoints;
+
+	void refill();
+	void flush_word();
+	uint64_t read_n_bits_slow(int n);
+	void write_n_bits_slow(uint64_t bits, int n);
+
+	template<int N> static void pack_block(const uint16_t* in, uint64_t* out);
+	template<int N> static void unpack_block(const uint64_t* in, uint16_t* out);
 
   public:
-	BitStream(std::fstream& fs, bool rw_status);
+	BitStream(std::fstream& fs, bool rw_status, int n_async_buffers = 0);
+	BitStream(const std::string& path, off_t offset = 0); // Memory-mapped reader
+	BitStream(const std::string& path, bool rw_status, off_t offset = 0, int n_async_buffers = 0); // From byte "offset" of the file
+	BitStream(std::vector<uint8_t>& buf); // In-memory writer, appends to buf
+	BitStream(std::span<const uint8_t> data); // In-memory reader
 
 	BitStream() = delete;
 	BitStream(const BitStream&) = delete;
@@ -45,9 +69,184 @@ class BitStream {
 	void write_bit(int bit);
 	void write_n_bits(uint64_t bits, int n);
 	void write_string(const std::string& s);
+	size_t read_bytes(uint8_t* data, size_t n);
+	void write_bytes(const uint8_t* data, size_t n);
+
+	uint64_t read_unary();
+	uint64_t read_elias_gamma();
+	uint64_t read_exp_golomb(int k);
+	void write_unary(uint64_t n);
+	bool write_elias_gamma(uint64_t v); // False for v == 0, which has no code
+	void write_exp_golomb(int k, uint64_t v);
+
+	template<int N> uint64_t read_bits();
+	template<int N> void write_bits(uint64_t bits);
+	template<int N> void pack(std::span<const uint16_t> values);
+	template<int N> void unpack(std::span<uint16_t> values);
+
 	off_t tell();
+	uint64_t tell_bit();
+	bool seek_bit(uint64_t pos);
+	void checkpoint(uint64_t block);
+	const std::vector<BitCheckpoint>& checkpoints() const;
+	bool is_open() const;
+	bool failed() const; // A read or write error (not the end of the file)
 	void close();
 };
 
+//-------------------------------------------------------------------------------------------
+//
+// Fast paths, inlined in the callers: one shift-or while the accumulator
+// has room (writing) or holds enough bits (reading)
+//
+inline uint64_t BitStream::read_n_bits(int n) {
+	if(n <= 0 or n > 56 or n > m_acc_bits)
+		return read_n_bits_slow(n);
+
+	uint64_t x = m_acc >> (64 - n);
+	m_acc <<= n;
+	m_acc_bits -= n;
+	return x;
+}
+
+inline void BitStream::write_n_bits(uint64_t bits, int n) {
+	if(n <= 0 or n >= 64 - m_acc_bits)
+		return write_n_bits_slow(bits, n);
+
+	m_acc = (m_acc << n) | (bits & ((uint64_t { 1 } << n) - 1));
+	m_acc_bits += n;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Fixed-width versions, with the width N known at compile time
+//
+template<int N>
+inline uint64_t BitStream::read_bits() {
+	static_assert(N > 0 and N <= 56);
+	if(N > m_acc_bits)
+		return read_n_bits_slow(N);
+
+	uint64_t x = m_acc >> (64 - N);
+	m_acc <<= N;
+	m_acc_bits -= N;
+	return x;
+}
+
+template<int N>
+inline void BitStream::write_bits(uint64_t bits) {
+	static_assert(N > 0 and N < 64);
+	if(N >= 64 - m_acc_bits)
+		return write_n_bits_slow(bits, N);
+
+	m_acc = (m_acc << N) | (bits & ((uint64_t { 1 } << N) - 1));
+	m_acc_bits += N;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Block kernels: 64 values of N bits <-> N 64-bit words, MSB first. Once the
+// loop is unrolled every shift amount and branch is a compile-time constant
+//
+template<int N>
+inline void BitStream::pack_block(const uint16_t* in, uint64_t* out) {
+	constexpr uint64_t mask { (uint64_t { 1 } << N) - 1 };
+	uint64_t acc { };
+	int acc_bits { };
+
+#pragma GCC unroll 64
+	for(int k = 0 ; k < 64 ; k++) {
+		uint64_t v = in[k] & mask;
+		if(acc_bits + N < 64) {
+			acc = (acc << N) | v;
+			acc_bits += N;
+		} else { // Complete a word; the low bits of v start the next one
+			int n_spill = acc_bits + N - 64;
+			*out++ = (acc << (64 - acc_bits)) | (v >> n_spill);
+			acc = v;
+			acc_bits = n_spill;
+		}
+	}
+}
+
+template<int N>
+inline void BitStream::unpack_block(const uint64_t* in, uint16_t* out) {
+	uint64_t acc { *in++ };
+	int acc_bits { 64 };
+
+#pragma GCC unroll 64
+	for(int k = 0 ; k < 64 ; k++) {
+		if(acc_bits >= N) {
+			out[k] = acc >> (64 - N);
+			acc <<= N;
+			acc_bits -= N;
+		} else { // The value straddles two words
+			int n_need = N - acc_bits;
+			uint64_t hi = acc_bits == 0 ? 0 : acc >> (64 - acc_bits);
+			uint64_t word = *in++;
+			out[k] = (hi << n_need) | (word >> (64 - n_need));
+			acc = word << n_need;
+			acc_bits = 64 - n_need;
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Bulk fixed-width writing/reading of whole arrays (N <= 16), 64 values at a
+// time. Values read past the end of the stream come out as all ones
+//
+template<int N>
+void BitStream::pack(std::span<const uint16_t> values) {
+	static_assert(N > 0 and N <= 16);
+	uint64_t words[N];
+	size_t n_blocks = values.size() / 64;
+	for(size_t b = 0 ; b < n_blocks ; b++) {
+		pack_block<N>(values.data() + 64 * b, words);
+		if(m_acc_bits == 0) { // Word aligned: straight to the byte stream
+			for(uint64_t& w : words)
+				w = __builtin_bswap64(w);
+
+			m_byte_stream.write(reinterpret_cast<uint8_t*>(words), sizeof(words));
+		} else {
+			for(uint64_t w : words)
+				write_n_bits_slow(w, 64);
+		}
+	}
+
+	for(size_t k = 64 * n_blocks ; k < values.size() ; k++)
+		write_bits<N>(values[k]);
+}
+
+template<int N>
+void BitStream::unpack(std::span<uint16_t> values) {
+	static_assert(N > 0 and N <= 16);
+	uint64_t words[N];
+	size_t n_blocks = values.size() / 64;
+	for(size_t b = 0 ; b < n_blocks ; b++) {
+		for(uint64_t& w : words) {
+			w = read_bits<32>() << 32;
+			w |= read_bits<32>() & 0xffffffff;
+		}
+
+		unpack_block<N>(words, values.data() + 64 * b);
+	}
+
+	for(size_t k = 64 * n_blocks ; k < values.size() ; k++)
+		values[k] = read_bits<N>();
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Dispatch tables of the N = 1..16 instantiations, for widths known only at
+// run time: look the kernel up once per stream, then call it per block.
+// Return nullptr for widths outside 1..16
+//
+typedef void (*BitPackFn)(BitStream& bs, std::span<const uint16_t> values);
+typedef void (*BitUnpackFn)(BitStream& bs, std::span<uint16_t> values);
+
+BitPackFn bit_pack_fn(int n_bits);
+BitUnpackFn bit_unpack_fn(int n_bits);
+
 #endif
 
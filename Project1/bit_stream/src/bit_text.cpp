@@ -0,0 +1,231 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <array>
+#include <cstring>
+#include "bit_text.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define BIT_TEXT_X86
+#endif
+
+using namespace std;
+
+//-------------------------------------------------------------------------------------------
+//
+// Lookup tables: the 8 chars of each byte, and each byte with its bits reversed
+//
+static const auto byte_text = [] {
+	array<uint64_t, 256> table { };
+	for(int b = 0 ; b < 256 ; b++) {
+		char s[8];
+		for(int i = 0 ; i < 8 ; i++)
+			s[i] = (b & (0x80 >> i)) ? '1' : '0';
+
+		memcpy(&table[b], s, 8);
+	}
+
+	return table;
+}();
+
+static const auto byte_reversed = [] {
+	array<uint8_t, 256> table { };
+	for(int b = 0 ; b < 256 ; b++)
+		for(int i = 0 ; i < 8 ; i++)
+			if(b & (1 << i))
+				table[b] |= 0x80 >> i;
+
+	return table;
+}();
+
+//-------------------------------------------------------------------------------------------
+//
+// Char by char conversion, for block tails and for blocks holding newlines
+//
+static bool text_to_bits_chars(const char* in, size_t n, BitStream& obs) {
+	for(size_t i = 0 ; i < n ; i++) {
+		switch(in[i]) {
+			case '0':
+				obs.write_bit(0);
+				break;
+			case '1':
+				obs.write_bit(1);
+				break;
+			case '\n':
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Scalar kernels: a table lookup per byte, and 8 chars at a time as one
+// 64-bit word (SWAR), whose low bits are gathered by a single multiplication
+//
+static void bits_to_text_scalar(const uint8_t* in, size_t n, char* out) {
+	for(size_t i = 0 ; i < n ; i++)
+		memcpy(out + 8 * i, &byte_text[in[i]], 8);
+}
+
+static bool text_to_bits_scalar(const char* in, size_t n, BitStream& obs) {
+	size_t i = 0;
+	for( ; i + 8 <= n ; i += 8) {
+		uint64_t x;
+		memcpy(&x, in + i, 8);
+		x ^= 0x3030303030303030; // '0' -> 0, '1' -> 1
+		if((x & 0xfefefefefefefefe) != 0) { // Newline or invalid char
+			if(not text_to_bits_chars(in + i, 8, obs))
+				return false;
+
+			continue;
+		}
+
+		obs.write_bits<8>((x * 0x8040201008040201) >> 56);
+	}
+
+	return text_to_bits_chars(in + i, n - i, obs);
+}
+
+#ifdef BIT_TEXT_X86
+
+//-------------------------------------------------------------------------------------------
+//
+// SSE2 kernels: 2 bytes <-> 16 chars
+//
+static void bits_to_text_sse2(const uint8_t* in, size_t n, char* out) {
+	const __m128i bit_mask = _mm_set1_epi64x(0x0102040810204080);
+	const __m128i zero_char = _mm_set1_epi8('0');
+	size_t i = 0;
+	for( ; i + 2 <= n ; i += 2) {
+		__m128i v = _mm_cvtsi32_si128(in[i] | (in[i+1] << 8));
+		v = _mm_unpacklo_epi8(v, v);	// b0 b0 b1 b1
+		v = _mm_unpacklo_epi16(v, v);	// b0 x4, b1 x4
+		v = _mm_unpacklo_epi32(v, v);	// b0 x8, b1 x8
+		__m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bit_mask), bit_mask);
+		_mm_storeu_si128((__m128i*)(out + 8 * i), _mm_sub_epi8(zero_char, set));
+	}
+
+	bits_to_text_scalar(in + i, n - i, out + 8 * i);
+}
+
+static bool text_to_bits_sse2(const char* in, size_t n, BitStream& obs) {
+	const __m128i zero_char = _mm_set1_epi8('0');
+	const __m128i one_char = _mm_set1_epi8('1');
+	size_t i = 0;
+	for( ; i + 16 <= n ; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i ones = _mm_cmpeq_epi8(v, one_char);
+		__m128i valid = _mm_or_si128(ones, _mm_cmpeq_epi8(v, zero_char));
+		if(_mm_movemask_epi8(valid) != 0xffff) { // Newline or invalid char
+			if(not text_to_bits_chars(in + i, 16, obs))
+				return false;
+
+			continue;
+		}
+
+		int m = _mm_movemask_epi8(ones); // Bit j is char j: reverse each byte
+		obs.write_bits<16>((byte_reversed[m & 0xff] << 8) | byte_reversed[m >> 8]);
+	}
+
+	return text_to_bits_scalar(in + i, n - i, obs);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// AVX2 kernels: 4 bytes <-> 32 chars
+//
+__attribute__((target("avx2")))
+static void bits_to_text_avx2(const uint8_t* in, size_t n, char* out) {
+	const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+	  2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i bit_mask = _mm256_set1_epi64x(0x0102040810204080);
+	const __m256i zero_char = _mm256_set1_epi8('0');
+	size_t i = 0;
+	for( ; i + 4 <= n ; i += 4) {
+		uint32_t w;
+		memcpy(&w, in + i, 4);
+		__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(w), spread);
+		__m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bit_mask), bit_mask);
+		_mm256_storeu_si256((__m256i*)(out + 8 * i), _mm256_sub_epi8(zero_char, set));
+	}
+
+	bits_to_text_sse2(in + i, n - i, out + 8 * i);
+}
+
+__attribute__((target("avx2")))
+static bool text_to_bits_avx2(const char* in, size_t n, BitStream& obs) {
+	const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	  7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const __m256i zero_char = _mm256_set1_epi8('0');
+	const __m256i one_char = _mm256_set1_epi8('1');
+	size_t i = 0;
+	for( ; i + 32 <= n ; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i ones = _mm256_cmpeq_epi8(v, one_char);
+		__m256i valid = _mm256_or_si256(ones, _mm256_cmpeq_epi8(v, zero_char));
+		if(_mm256_movemask_epi8(valid) != -1) { // Newline or invalid char
+			if(not text_to_bits_chars(in + i, 32, obs))
+				return false;
+
+			continue;
+		}
+
+		// With each group of 8 chars reversed, byte k of the mask is output byte k
+		uint32_t m = _mm256_movemask_epi8(_mm256_shuffle_epi8(ones, reverse));
+		obs.write_bits<32>(__builtin_bswap32(m));
+	}
+
+	return text_to_bits_sse2(in + i, n - i, obs);
+}
+
+#endif
+
+//-------------------------------------------------------------------------------------------
+
+typedef void (*BitsToTextFn)(const uint8_t* in, size_t n, char* out);
+typedef bool (*TextToBitsFn)(const char* in, size_t n, BitStream& obs);
+
+void bits_to_text(const uint8_t* in, size_t n, char* out) {
+	static const BitsToTextFn kernel = [] {
+#ifdef BIT_TEXT_X86
+		return __builtin_cpu_supports("avx2") ? bits_to_text_avx2 : bits_to_text_sse2;
+#else
+		return bits_to_text_scalar;
+#endif
+	}();
+
+	kernel(in, n, out);
+}
+
+bool text_to_bits(const char* in, size_t n, BitStream& obs) {
+	static const TextToBitsFn kernel = [] {
+#ifdef BIT_TEXT_X86
+		return __builtin_cpu_supports("avx2") ? text_to_bits_avx2 : text_to_bits_sse2;
+#else
+		return text_to_bits_scalar;
+#endif
+	}();
+
+	return kernel(in, n, obs);
+}
+
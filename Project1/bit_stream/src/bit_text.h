@@ -0,0 +1,41 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef BIT_TEXT_H
+#define BIT_TEXT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "bit_stream.h"
+
+//-------------------------------------------------------------------------------------------
+//
+// Block converters between binary data and its textual form (one '0'/'1'
+// char per bit, MSB first), used by bin2text and text2bin. Both pick, once,
+// an AVX2, SSE2 or scalar kernel according to the running CPU.
+//
+// bits_to_text: expands the n bytes of "in" into the 8 * n chars of "out".
+//
+// text_to_bits: writes the bits spelled by the n chars of "in" to "obs".
+// Newlines are skipped; any other char makes it stop and return false.
+//
+void bits_to_text(const uint8_t* in, size_t n, char* out);
+bool text_to_bits(const char* in, size_t n, BitStream& obs);
+
+#endif
+
@@ -16,21 +16,668 @@
 //
 //-------------------------------------------------------------------------------------------
 
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING
+#endif
 #include "byte_stream.h"
 
 using namespace std;
 
+//-------------------------------------------------------------------------------------------
+//
+// Background writer: a pool of BYTE_STREAM_BUF_SIZE buffers, a queue of
+// filled ones and a thread that writes them to the file in order
+//
+class ByteStream::AsyncWriter {
+  private:
+	fstream&							m_fs;
+	vector<unique_ptr<uint8_t[]>>		m_pool;
+	vector<uint8_t*>					m_free;
+	deque<pair<uint8_t*, size_t>>		m_queue;
+	int									m_n_busy { }; // Buffers being written
+	bool								m_stop { false };
+	mutex								m_mutex;
+	condition_variable					m_cv;
+	thread								m_thread;
+
+	void run() {
+		unique_lock<mutex> lock { m_mutex };
+		while(true) {
+			m_cv.wait(lock, [this] { return m_stop or not m_queue.empty(); });
+			if(m_queue.empty()) // Stopped, and nothing left to write
+				return;
+
+			auto [buf, n] = m_queue.front();
+			m_queue.pop_front();
+			m_n_busy++;
+			lock.unlock();
+			m_fs.write((char*)buf, n);
+			lock.lock();
+			m_n_busy--;
+			m_free.push_back(buf);
+			m_cv.notify_all();
+		}
+	}
+
+  public:
+	AsyncWriter(fstream& fs, int n_buffers) : m_fs { fs } {
+		for(int n = 0 ; n < n_buffers ; n++) {
+			m_pool.emplace_back(new uint8_t[BYTE_STREAM_BUF_SIZE]);
+			m_free.push_back(m_pool.back().get());
+		}
+
+		m_thread = thread { &AsyncWriter::run, this };
+	}
+
+	~AsyncWriter() {
+		{
+			lock_guard<mutex> lock { m_mutex };
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	// Waits for a free buffer and takes it
+	uint8_t* acquire() {
+		unique_lock<mutex> lock { m_mutex };
+		m_cv.wait(lock, [this] { return not m_free.empty(); });
+		uint8_t* buf = m_free.back();
+		m_free.pop_back();
+		return buf;
+	}
+
+	// Queues the first n bytes of buf for writing
+	void submit(uint8_t* buf, size_t n) {
+		{
+			lock_guard<mutex> lock { m_mutex };
+			m_queue.emplace_back(buf, n);
+		}
+		m_cv.notify_all();
+	}
+
+	// Completion barrier: returns once every queued buffer is on the file
+	void wait() {
+		unique_lock<mutex> lock { m_mutex };
+		m_cv.wait(lock, [this] { return m_queue.empty() and m_n_busy == 0; });
+	}
+};
+
+//-------------------------------------------------------------------------------------------
+//
+// io_uring queue over raw system calls: "depth" buffers of "block" bytes,
+// each of them read or written at its own file offset. Buffers are used in
+// turn, so a reader consumes them in file order while the following ones
+// are being read, and a writer fills one while the previous ones are being
+// written. ok() is false when the kernel does not provide io_uring. If the
+// ring itself fails, the requests are done with pread/pwrite from then on;
+// error() is the errno of the first failed read handed over or write
+//
+class ByteStream::Uring {
+  private:
+	struct Slot {
+		unique_ptr<uint8_t[]>	buf;
+		bool					busy { false };
+		bool					write { false };
+		size_t					len { };
+		off_t					offset { };
+		int						res { };
+	};
+
+	int				m_fd;
+	bool			m_own_fd { false };
+	int				m_ring_fd { -1 };
+	size_t			m_block;
+	vector<Slot>	m_slots;
+	int				m_cur { };		// Slot being read or filled
+	off_t			m_offset { };	// File offset of the next block to submit
+	bool			m_eof { false };
+	bool			m_broken { false };	// io_uring_enter failed: synchronous I/O only
+	int				m_error { };
+
+#ifdef HAVE_IO_URING
+	void*			m_sq_ring { MAP_FAILED };
+	void*			m_cq_ring { MAP_FAILED };
+	size_t			m_sq_ring_size { };
+	size_t			m_cq_ring_size { };
+	io_uring_sqe*	m_sqes { static_cast<io_uring_sqe*>(MAP_FAILED) };
+	size_t			m_sqes_size { };
+	unsigned*		m_sq_tail;
+	unsigned*		m_sq_mask;
+	unsigned*		m_sq_array;
+	unsigned*		m_cq_head;
+	unsigned*		m_cq_tail;
+	unsigned*		m_cq_mask;
+	io_uring_cqe*	m_cqes;
+
+	void submit(int slot, bool write, size_t len, off_t offset) {
+		Slot& s = m_slots[slot];
+		s.busy = true;
+		s.write = write;
+		s.len = len;
+		s.offset = offset;
+		if(m_broken) {
+			complete_now(s);
+			return;
+		}
+
+		unsigned tail = *m_sq_tail;
+		unsigned idx = tail & *m_sq_mask;
+		io_uring_sqe& sqe = m_sqes[idx];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+		sqe.fd = m_fd;
+		sqe.addr = reinterpret_cast<uint64_t>(s.buf.get());
+		sqe.len = len;
+		sqe.off = offset;
+		sqe.user_data = slot;
+		m_sq_array[idx] = idx;
+		__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+		long n;
+		while((n = syscall(__NR_io_uring_enter, m_ring_fd, 1, 0, 0, nullptr, 0)) < 0 and errno == EINTR)
+			;
+
+		if(n < 1) { // Nothing was consumed: take the entry back and do it here
+			__atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+			m_broken = true;
+			complete_now(s);
+		}
+	}
+
+	// Collects the completed requests, waiting for at least one
+	void reap() {
+		for(;;) {
+			unsigned head = *m_cq_head;
+			unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			if(head != tail) {
+				for( ; head != tail ; head++) {
+					const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+					m_slots[cqe.user_data].res = cqe.res;
+					m_slots[cqe.user_data].busy = false;
+				}
+
+				__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+				return;
+			}
+
+			if(syscall(__NR_io_uring_enter, m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+			  and errno != EINTR) { // The requests in flight are lost: fail them
+				int err = errno;
+				for(Slot& s : m_slots)
+					if(s.busy) {
+						s.res = -err;
+						s.busy = false;
+					}
+
+				m_broken = true;
+				return;
+			}
+		}
+	}
+#else
+	void submit(int, bool, size_t, off_t) { }
+	void reap() { }
+#endif
+
+	// Does the request of slot "s" synchronously
+	void complete_now(Slot& s) {
+		ssize_t n = s.write ? pwrite(m_fd, s.buf.get(), s.len, s.offset) : pread(m_fd, s.buf.get(), s.len, s.offset);
+		s.res = n < 0 ? -errno : n;
+		s.busy = false;
+	}
+
+	// Waits for the request of "slot". Short transfers are completed with
+	// pwrite/pread, so a read is only short at the end of the file; a write
+	// that still fails sets error()
+	int wait(int slot) {
+		Slot& s = m_slots[slot];
+		while(s.busy)
+			reap();
+
+		if(s.res >= 0 and static_cast<size_t>(s.res) < s.len) {
+			size_t n_done = s.res;
+			ssize_t n = 0;
+			while(n_done < s.len and (n = s.write ? pwrite(m_fd, s.buf.get() + n_done, s.len - n_done, s.offset + n_done)
+			  : pread(m_fd, s.buf.get() + n_done, s.len - n_done, s.offset + n_done)) > 0)
+				n_done += n;
+
+			if(n < 0)
+				s.res = -errno;
+			else
+				s.res = n_done < s.len and s.write ? -EIO : n_done; // A read stops at the end of the file
+		}
+
+		if(s.write and s.res < 0 and m_error == 0)
+			m_error = -s.res;
+
+		return s.res;
+	}
+
+  public:
+	Uring(int fd, int depth, size_t block) : m_fd { fd }, m_block { block }, m_slots(depth) {
+#ifdef HAVE_IO_URING
+		io_uring_params p;
+		memset(&p, 0, sizeof(p));
+		if((m_ring_fd = syscall(__NR_io_uring_setup, depth, &p)) < 0)
+			return;
+
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if(p.features & IORING_FEAT_SINGLE_MMAP)
+			m_sq_ring_size = m_cq_ring_size = max(m_sq_ring_size, m_cq_ring_size);
+
+		m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  m_ring_fd, IORING_OFF_SQ_RING);
+		if(m_sq_ring == MAP_FAILED)
+			return;
+
+		if(p.features & IORING_FEAT_SINGLE_MMAP)
+			m_cq_ring = m_sq_ring;
+		else if((m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  m_ring_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+			return;
+
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+		if(m_sqes == MAP_FAILED)
+			return;
+
+		uint8_t* sq = static_cast<uint8_t*>(m_sq_ring);
+		uint8_t* cq = static_cast<uint8_t*>(m_cq_ring);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		m_sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		m_cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+		for(Slot& s : m_slots)
+			s.buf.reset(new uint8_t[block]);
+#endif
+	}
+
+	~Uring() {
+		if(ok())
+			wait_all();
+
+#ifdef HAVE_IO_URING
+		if(m_sqes != MAP_FAILED)
+			munmap(m_sqes, m_sqes_size);
+
+		if(m_cq_ring != MAP_FAILED and m_cq_ring != m_sq_ring)
+			munmap(m_cq_ring, m_cq_ring_size);
+
+		if(m_sq_ring != MAP_FAILED)
+			munmap(m_sq_ring, m_sq_ring_size);
+#endif
+
+		if(m_ring_fd >= 0)
+			::close(m_ring_fd);
+
+		if(m_own_fd)
+			::close(m_fd);
+	}
+
+	// Closes the file descriptor on destruction
+	void adopt_fd() {
+		m_own_fd = true;
+	}
+
+	bool ok() const {
+		return not m_slots.empty() and m_slots[0].buf != nullptr;
+	}
+
+	int error() const {
+		return m_error;
+	}
+
+	void wait_all() {
+		for(size_t slot = 0 ; slot < m_slots.size() ; slot++)
+			wait(slot);
+	}
+
+	// Reading: (re)starts read-ahead at file offset "offset"
+	void start_reading(off_t offset) {
+		wait_all();
+		m_offset = offset;
+		m_eof = false;
+		for(size_t slot = 0 ; slot < m_slots.size() ; slot++, m_offset += m_block)
+			submit(slot, false, m_block, m_offset);
+
+		m_cur = -1;
+	}
+
+	// Reading: hands over the next block, requeueing the one just consumed.
+	// A short block is the last one. Returns false at the end of the file,
+	// or on a read error (see error())
+	bool next_block(uint8_t*& begin, uint8_t*& end) {
+		if(m_eof)
+			return false;
+
+		if(m_cur >= 0) {
+			submit(m_cur, false, m_block, m_offset);
+			m_offset += m_block;
+		}
+
+		m_cur = (m_cur + 1) % m_slots.size();
+		int n = wait(m_cur);
+		if(n <= 0) {
+			if(n < 0 and m_error == 0)
+				m_error = -n;
+
+			m_eof = true;
+			return false;
+		}
+
+		if(static_cast<size_t>(n) < m_block) // The slots after it are past the end
+			m_eof = true;
+
+		begin = m_slots[m_cur].buf.get();
+		end = begin + n;
+		return true;
+	}
+
+	// Writing: starts at file offset "offset"; returns the first buffer
+	uint8_t* start_writing(off_t offset) {
+		m_offset = offset;
+		m_cur = 0;
+		return m_slots[0].buf.get();
+	}
+
+	// Writing: queues the first n bytes of the current buffer and returns the
+	// next one, once it is free
+	uint8_t* next_buffer(size_t n) {
+		submit(m_cur, true, n, m_offset);
+		m_offset += n;
+		m_cur = (m_cur + 1) % m_slots.size();
+		wait(m_cur);
+		return m_slots[m_cur].buf.get();
+	}
+
+	uint8_t* buffer() const {
+		return m_slots[m_cur].buf.get();
+	}
+
+	size_t block_size() const {
+		return m_block;
+	}
+};
+
+//-------------------------------------------------------------------------------------------
+//
+// io_uring settings for new streams, by default from BYTE_STREAM_URING
+//
+static int uring_depth { -1 }; // Not yet set
+static size_t uring_block { 256 * 1024 };
+
+void ByteStream::use_uring(int depth, size_t block_size) {
+	uring_depth = depth;
+	uring_block = block_size;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Switches a stream on file descriptor "fd" to io_uring, starting at byte
+// "offset". Returns false, leaving the stream (and fd) as it was, if io_uring
+// is not enabled or not available, or the file is not a regular one. On
+// success, the stream owns fd if "own_fd"
+//
+bool ByteStream::start_uring(int fd, off_t offset, bool own_fd) {
+	if(uring_depth < 0) {
+		uring_depth = 0;
+		if(const char* env = getenv("BYTE_STREAM_URING")) {
+			char* end;
+			uring_depth = strtol(env, &end, 10);
+			if(*end == ':')
+				uring_block = strtoul(end + 1, nullptr, 10) * 1024;
+		}
+	}
+
+	struct stat st;
+	if(uring_depth < 2 or uring_block == 0 or fd < 0 or offset < 0 or fstat(fd, &st) != 0
+	  or not S_ISREG(st.st_mode))
+		return false;
+
+	auto uring = make_unique<Uring>(fd, uring_depth, uring_block);
+	if(not uring->ok())
+		return false;
+
+	if(own_fd)
+		uring->adopt_fd();
+
+	m_uring = std::move(uring);
+	m_fs_start = offset;
+	if(m_rw_status) {
+		m_uring->start_reading(offset);
+		m_buf_ptr = m_buf_limit = m_buf;
+	} else {
+		m_buf_ptr = m_uring->start_writing(offset);
+		m_buf_limit = m_buf_ptr + m_uring->block_size();
+	}
+
+	return true;
+}
+
 //-------------------------------------------------------------------------------------------
 
-ByteStream::ByteStream(fstream& fs, bool rw_status) : m_rw_status { rw_status }, m_fs { fs } {
-	m_buf_limit = m_buf + BYTE_STREAM_BUF_SIZE;
-	if(m_rw_status) { // Open for reading
-		m_buf_ptr = m_buf_limit;
-		m_size = BYTE_STREAM_BUF_SIZE;
+ByteStream::ByteStream(fstream& fs, bool rw_status, int n_async_buffers) : m_rw_status { rw_status },
+  m_fs { &fs } {
+	if(m_rw_status) { // Open for reading: the buffer starts empty
+		m_buf_ptr = m_buf;
+		m_buf_limit = m_buf;
+		m_fs_start = fs.tellg();
 	}
 
-	else // Open for writing
+	else { // Open for writing
 		m_buf_ptr = m_buf;
+		if(n_async_buffers >= 2) {
+			m_async = make_unique<AsyncWriter>(fs, n_async_buffers);
+			m_buf_ptr = m_async->acquire();
+		}
+
+		m_buf_limit = m_buf_ptr + BYTE_STREAM_BUF_SIZE;
+	}
+}
+
+//---------------------------------------------------------------------------------
+//
+// Memory-mapped reader of the file "path", starting at byte "offset" (an
+// io_uring reader instead, when enabled)
+//
+ByteStream::ByteStream(const string& path, off_t offset) {
+	open_read(path, offset);
+}
+
+//---------------------------------------------------------------------------------
+//
+// Stream on the file "path" from byte "offset" on: the reader above, or a
+// writer that keeps the first "offset" bytes of the file and replaces the
+// rest (see open_write())
+//
+ByteStream::ByteStream(const string& path, bool rw_status, off_t offset, int n_async_buffers) :
+  m_rw_status { rw_status } {
+	if(m_rw_status)
+		open_read(path, offset);
+	else
+		open_write(path, offset, n_async_buffers);
+}
+
+//---------------------------------------------------------------------------------
+
+void ByteStream::open_read(const string& path, off_t offset) {
+	m_buf_ptr = m_buf;
+	m_buf_limit = m_buf;
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd >= 0 and start_uring(fd, offset, true))
+		return;
+
+	if(fd >= 0) {
+		struct stat st;
+		if(fstat(fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > offset) {
+			void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED) {
+				madvise(map, st.st_size, MADV_SEQUENTIAL);
+				m_map = static_cast<uint8_t*>(map);
+				m_map_size = st.st_size;
+				m_base = m_buf_ptr = m_map + offset;
+				m_buf_limit = m_map + m_map_size;
+			}
+		}
+
+		::close(fd); // The mapping stays valid after the descriptor is closed
+	}
+
+	if(m_map == nullptr) { // Not mappable: fall back to the buffered reader
+		m_own_fs.open(path, ios::in | ios::binary);
+		if(offset != 0)
+			m_own_fs.seekg(offset);
+
+		m_fs = &m_own_fs;
+		m_fs_start = m_own_fs.tellg();
+	}
+}
+
+//---------------------------------------------------------------------------------
+//
+// Writer of the file "path" (created if needed), cut to its first "offset"
+// bytes, e.g. a header written by the caller, who must have closed or
+// flushed it. Goes through io_uring on its own descriptor when enabled, and
+// otherwise through an fstream of its own, asynchronous if n_async_buffers
+// >= 2
+//
+void ByteStream::open_write(const string& path, off_t offset, int n_async_buffers) {
+	m_buf_ptr = m_buf;
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0666);
+	if(fd >= 0 and ftruncate(fd, offset) == 0 and start_uring(fd, offset, true))
+		return;
+
+	if(fd >= 0)
+		::close(fd);
+
+	if(offset == 0)
+		m_own_fs.open(path, ios::out | ios::binary);
+	else {
+		m_own_fs.open(path, ios::in | ios::out | ios::binary);
+		m_own_fs.seekp(offset);
+	}
+
+	m_fs = &m_own_fs;
+	if(n_async_buffers >= 2 and m_own_fs.is_open()) {
+		m_async = make_unique<AsyncWriter>(m_own_fs, n_async_buffers);
+		m_buf_ptr = m_async->acquire();
+	}
+
+	m_buf_limit = m_buf_ptr + BYTE_STREAM_BUF_SIZE;
+}
+
+//---------------------------------------------------------------------------------
+//
+// In-memory writer: appends to "buf", whose size is kept equal to the number
+// of bytes actually written after each flush()
+//
+ByteStream::ByteStream(vector<uint8_t>& buf) : m_rw_status { STREAM_WRITE }, m_vec { &buf } {
+	size_t n_bytes = buf.size();
+	buf.resize(n_bytes + BYTE_STREAM_BUF_SIZE);
+	m_buf_ptr = buf.data() + n_bytes;
+	m_buf_limit = buf.data() + buf.size();
+}
+
+//---------------------------------------------------------------------------------
+//
+// In-memory reader of "data", which must outlive the stream. The data is
+// never written through m_buf_ptr
+//
+ByteStream::ByteStream(span<const uint8_t> data) : m_rw_status { STREAM_READ } {
+	m_base = m_buf_ptr = const_cast<uint8_t*>(data.data());
+	m_buf_limit = m_buf_ptr + data.size();
+}
+
+//---------------------------------------------------------------------------------
+
+ByteStream::~ByteStream() {
+	if(m_map != nullptr)
+		munmap(m_map, m_map_size);
+}
+
+//---------------------------------------------------------------------------------
+//
+// Reads the next block into the (empty) buffer. Returns false at the end of
+// the file, which for a mapping or a span is the end of the data itself
+//
+bool ByteStream::fill() {
+	if(m_uring != nullptr) {
+		if(m_uring->next_block(m_buf_ptr, m_buf_limit))
+			return true;
+
+		uring_status();
+		return false;
+	}
+
+	if(m_fs == nullptr)
+		return false;
+
+	m_fs->read((char*)m_buf, BYTE_STREAM_BUF_SIZE);
+	size_t n_bytes = m_fs->gcount();
+	m_buf_ptr = m_buf;
+	m_buf_limit = m_buf + n_bytes;
+	return n_bytes != 0;
+}
+
+//---------------------------------------------------------------------------------
+//
+// Carries an io_uring read or write error into the stream state
+//
+void ByteStream::uring_status() {
+	if(m_uring->error() != 0)
+		m_failed = true;
+}
+
+//---------------------------------------------------------------------------------
+//
+// Makes room in the (full) output buffer: writes it to the file (or queues
+// it, when asynchronous), or doubles the size of the output vector
+//
+void ByteStream::drain() {
+	if(m_vec != nullptr) {
+		size_t n_bytes = m_buf_ptr - m_vec->data();
+		m_vec->resize(n_bytes < BYTE_STREAM_BUF_SIZE ? n_bytes + BYTE_STREAM_BUF_SIZE : 2 * n_bytes);
+		m_buf_ptr = m_vec->data() + n_bytes;
+		m_buf_limit = m_vec->data() + m_vec->size();
+	}
+
+	else if(m_uring != nullptr) {
+		m_buf_ptr = m_uring->next_buffer(m_buf_ptr - m_uring->buffer());
+		m_buf_limit = m_buf_ptr + m_uring->block_size();
+		uring_status();
+	}
+
+	else if(m_async != nullptr) { // Hand the buffer to the I/O thread, go on in a free one
+		m_async->submit(m_buf_limit - BYTE_STREAM_BUF_SIZE, BYTE_STREAM_BUF_SIZE);
+		m_buf_ptr = m_async->acquire();
+		m_buf_limit = m_buf_ptr + BYTE_STREAM_BUF_SIZE;
+	}
+
+	else {
+		m_fs->write((char*)m_buf, BYTE_STREAM_BUF_SIZE);
+		m_buf_ptr = m_buf;
+	}
 }
 
 //---------------------------------------------------------------------------------
@@ -38,13 +685,11 @@ ByteStream::ByteStream(fstream& fs, bool rw_status) : m_rw_status { rw_status },
 // m_buf_ptr points to the next free buffer position
 //
 void ByteStream::put(int c) {
+	if(m_buf_ptr == m_buf_limit) // buffer is full: write it
+		drain();
+
 	*m_buf_ptr++ = c;
 	m_tell++;
-
-	if(m_buf_ptr == m_buf_limit) { // buffer is full: write it
-		m_fs.write((char*)m_buf, BYTE_STREAM_BUF_SIZE);
-		m_buf_ptr = m_buf;
-	}
 }
 
 //---------------------------------------------------------------------------------
@@ -52,30 +697,120 @@ void ByteStream::put(int c) {
 // m_buf_ptr points to the next buffer char
 //
 int ByteStream::get() {
-	if(m_buf_ptr == m_buf_limit) { // buffer is empty: get another block
-		m_fs.read((char*)m_buf, BYTE_STREAM_BUF_SIZE);
-		if((m_size = m_fs.gcount()) == 0)
-			return EOF;
-
-		m_buf_ptr = m_buf;
-	} else {
-		if(m_buf_ptr - m_buf == m_size)
-			return EOF;
-	}
+	if(m_buf_ptr == m_buf_limit and not fill()) // buffer is empty: get another block
+		return EOF;
 
 	m_tell++;
 	return *m_buf_ptr++;
 }
 
+//---------------------------------------------------------------------------------
+//
+// Block version of put(): copies n bytes into the buffer, writing it out
+// every time it is full
+//
+void ByteStream::write(const uint8_t* data, size_t n) {
+	m_tell += n;
+	while(n != 0) {
+		if(m_buf_ptr == m_buf_limit) // buffer is full: write it
+			drain();
+
+		size_t n_free = m_buf_limit - m_buf_ptr;
+		size_t n_copy = n < n_free ? n : n_free;
+		memcpy(m_buf_ptr, data, n_copy);
+		m_buf_ptr += n_copy;
+		data += n_copy;
+		n -= n_copy;
+	}
+}
+
+//---------------------------------------------------------------------------------
+//
+// Block version of get(): copies up to n bytes out of the buffer, reading
+// another block whenever it empties. Returns the number of bytes copied,
+// which is less than n only at the end of the file
+//
+size_t ByteStream::read(uint8_t* data, size_t n) {
+	size_t n_read = 0;
+	while(n_read != n) {
+		if(m_buf_ptr == m_buf_limit and not fill()) // buffer is empty: get another block
+			break;
+
+		size_t n_avail = m_buf_limit - m_buf_ptr;
+		size_t n_copy = n - n_read < n_avail ? n - n_read : n_avail;
+		memcpy(data + n_read, m_buf_ptr, n_copy);
+		m_buf_ptr += n_copy;
+		n_read += n_copy;
+	}
+
+	m_tell += n_read;
+	return n_read;
+}
+
+//---------------------------------------------------------------------------------
+//
+// Appends the bytes before the next "delim" to s, scanning the buffer with
+// memchr. The delimiter is consumed but not appended. Returns false if the
+// file ends first
+//
+bool ByteStream::read_until(uint8_t delim, string& s) {
+	for(;;) {
+		if(m_buf_ptr == m_buf_limit and not fill())
+			return false;
+
+		size_t n_avail = m_buf_limit - m_buf_ptr;
+		uint8_t* p = static_cast<uint8_t*>(memchr(m_buf_ptr, delim, n_avail));
+		size_t n_copy = p == nullptr ? n_avail : p - m_buf_ptr;
+		s.append(reinterpret_cast<char*>(m_buf_ptr), n_copy);
+		m_buf_ptr += n_copy;
+		m_tell += n_copy;
+		if(p != nullptr) {
+			m_buf_ptr++;
+			m_tell++;
+			return true;
+		}
+	}
+}
+
 //---------------------------------------------------------------------------------
 //
 // m_buf_ptr points to a free buffer position
 //
 void ByteStream::flush() {
+	if(m_vec != nullptr) { // Trim the vector to what was written
+		size_t n_bytes = m_buf_ptr - m_vec->data();
+		m_vec->resize(n_bytes);
+		m_buf_ptr = m_buf_limit = m_vec->data() + n_bytes;
+		return;
+	}
+
+	if(m_uring != nullptr) { // Queue the partial buffer and wait until all is written
+		if(m_buf_ptr != m_uring->buffer()) {
+			m_buf_ptr = m_uring->next_buffer(m_buf_ptr - m_uring->buffer());
+			m_buf_limit = m_buf_ptr + m_uring->block_size();
+		}
+
+		m_uring->wait_all();
+		uring_status();
+		return;
+	}
+
+	if(m_async != nullptr) { // Queue the partial buffer and wait until all is written
+		uint8_t* buf = m_buf_limit - BYTE_STREAM_BUF_SIZE;
+		if(m_buf_ptr != buf) {
+			m_async->submit(buf, m_buf_ptr - buf);
+			m_buf_ptr = m_async->acquire();
+			m_buf_limit = m_buf_ptr + BYTE_STREAM_BUF_SIZE;
+		}
+
+		m_async->wait();
+		return;
+	}
+
 	size_t n_bytes_to_write = m_buf_ptr - m_buf;
 
 	if(n_bytes_to_write != 0) { // If buf is not empty
-		m_fs.write((char*)m_buf, n_bytes_to_write);
+		m_fs->write((char*)m_buf, n_bytes_to_write);
 		m_buf_ptr = m_buf;
 	}
 }
@@ -86,13 +821,97 @@ off_t ByteStream::tell() {
 	return m_tell;
 }
 
+//---------------------------------------------------------------------------------
+//
+// Moves a reader to byte "pos" (counted, like tell(), from the start of the
+// stream). Returns false for writers, for streams that cannot seek (pipes)
+// and for positions past the end of in-memory data
+//
+bool ByteStream::seek(off_t pos) {
+	if(not m_rw_status or pos < 0)
+		return false;
+
+	if(m_uring != nullptr) { // Restart the read-ahead there
+		m_uring->start_reading(m_fs_start + pos);
+		m_buf_ptr = m_buf_limit = m_buf;
+	}
+
+	else if(m_fs == nullptr) { // Mapped or in-memory: just move the pointer
+		if(pos > m_buf_limit - m_base)
+			return false;
+
+		m_buf_ptr = m_base + pos;
+	}
+
+	else {
+		if(m_fs_start < 0)
+			return false;
+
+		m_fs->clear();
+		if(not m_fs->seekg(m_fs_start + pos))
+			return false;
+
+		m_buf_ptr = m_buf_limit = m_buf; // Drop the buffered block
+	}
+
+	m_tell = pos;
+	return true;
+}
+
+//---------------------------------------------------------------------------------
+
+bool ByteStream::is_open() const {
+	return m_fs == nullptr or m_fs->is_open();
+}
+
+//---------------------------------------------------------------------------------
+
+bool ByteStream::is_mapped() const {
+	return m_map != nullptr;
+}
+
+//---------------------------------------------------------------------------------
+
+bool ByteStream::is_uring() const {
+	return m_uring != nullptr;
+}
+
+//---------------------------------------------------------------------------------
+//
+// True once a read or a write has failed (as opposed to a reader simply
+// reaching the end of the file)
+//
+bool ByteStream::failed() const {
+	return m_failed or (m_fs != nullptr and m_fs->bad());
+}
+
 //---------------------------------------------------------------------------------
 
 void ByteStream::close() {
 	if(not m_rw_status)
 		this->flush();
 
-	m_fs.close();
+	if(m_map != nullptr) {
+		munmap(m_map, m_map_size);
+		m_map = nullptr;
+		m_buf_ptr = m_buf_limit = m_buf;
+	}
+
+	if(m_uring != nullptr) { // Waits for the reads in flight and tears the queue down
+		m_uring.reset();
+		m_buf_ptr = m_buf_limit = m_buf;
+		if(not m_rw_status)
+			m_buf_limit = m_buf + BYTE_STREAM_BUF_SIZE;
+	}
+
+	if(m_async != nullptr) { // Stops the I/O thread
+		m_async.reset();
+		m_buf_ptr = m_buf;
+		m_buf_limit = m_buf + BYTE_STREAM_BUF_SIZE;
+	}
+
+	if(m_fs != nullptr)
+		m_fs->close();
 }
 
 //---------------------------------------------------------------------------------
@@ -20,24 +20,83 @@
 #define BYTE_STREAM_H
 
 #include <fstream>
+#include <string>
+#include <vector>
+#include <span>
+#include <memory>
 #include <cstdint>
 
 const int BYTE_STREAM_BUF_SIZE = 65536;
 const bool STREAM_READ = true;
 const bool STREAM_WRITE = false;
 
+//-------------------------------------------------------------------------------------------
+//
+// Read backends: the buffered one, which copies blocks of an fstream into
+// m_buf, a memory-mapped one (path constructor) and an in-memory one (span
+// constructor). In the last two m_buf_ptr walks the whole data directly. The
+// mapped backend falls back to a buffered fstream of its own when the file
+// cannot be mapped (e.g. a pipe).
+//
+// Write backends: the buffered fstream one, and an in-memory one (vector
+// constructor) that appends to a caller's vector, growing it as needed, with
+// m_buf_ptr pointing into the vector itself. The fstream writer can also be
+// asynchronous (n_async_buffers >= 2): full buffers are handed to a background
+// I/O thread and filling goes on in the next free one. flush() and close()
+// wait for all pending writes.
+//
+// The streams opened by path (the mapped reader, and a writer that works
+// like the fstream one on a file of its own) can instead go through Linux
+// io_uring (see use_uring(), or set BYTE_STREAM_URING=depth[:block_kib] in
+// the environment): several large reads are kept in flight ahead of the
+// reader, or several writes behind the writer, with m_buf_ptr walking the
+// io_uring buffers. When io_uring is unavailable, the usual backend is used.
+// Streams on a caller's fstream always use the fstream backends.
+//
+// failed() tells a read or write error from the end of the file: it is set
+// by io_uring errors and reflects badbit on the fstream of the other file
+// backends.
+//
+// m_buf_limit is one past the last valid byte when reading, and one past the
+// end of the output buffer when writing.
+//
 class ByteStream {
   private:
 	uint8_t			m_buf[BYTE_STREAM_BUF_SIZE];
 	uint8_t*		m_buf_ptr;
 	uint8_t*		m_buf_limit;
-	int				m_size;
 	bool			m_rw_status { STREAM_READ };
 	off_t			m_tell { };
-	std::fstream&	m_fs;
+	std::fstream*	m_fs { };
+	std::fstream	m_own_fs;
+	uint8_t*		m_map { };
+	size_t			m_map_size { };
+	std::vector<uint8_t>* m_vec { };
+	uint8_t*		m_base { };		// Start of the data, for in-memory readers
+	off_t			m_fs_start { };	// File position of the start, for fstream readers
+	bool			m_failed { false };	// A read or write error was seen
+
+	class AsyncWriter;
+	std::unique_ptr<AsyncWriter> m_async;
+
+	class Uring;
+	std::unique_ptr<Uring> m_uring;
+	bool start_uring(int fd, off_t offset, bool own_fd);
+	void uring_status();
+
+	void open_read(const std::string& path, off_t offset);
+	void open_write(const std::string& path, off_t offset, int n_async_buffers);
+
+	bool fill();
+	void drain();
 
   public:
-	ByteStream(std::fstream& fs, bool rw_status);
+	ByteStream(std::fstream& fs, bool rw_status, int n_async_buffers = 0);
+	ByteStream(const std::string& path, off_t offset = 0);
+	ByteStream(const std::string& path, bool rw_status, off_t offset = 0, int n_async_buffers = 0);
+	ByteStream(std::vector<uint8_t>& buf);
+	ByteStream(std::span<const uint8_t> data);
+	~ByteStream();
 
 	ByteStream() = delete;
 	ByteStream(const ByteStream&) = delete;
@@ -47,9 +106,21 @@ class ByteStream {
 
 	void put(int c);
 	int get();
+	void write(const uint8_t* data, size_t n);
+	size_t read(uint8_t* data, size_t n);
+	bool read_until(uint8_t delim, std::string& s);
 	void flush();
 	off_t tell();
+	bool seek(off_t pos);
+	bool is_open() const;
+	bool is_mapped() const;
+	bool is_uring() const;
+	bool failed() const;
 	void close();
+
+	// Queue depth (< 2 disables io_uring) and block size of the streams
+	// opened from now on
+	static void use_uring(int depth, size_t block_size = 256 * 1024);
 };
 
 #endif
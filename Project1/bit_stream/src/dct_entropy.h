@@ -0,0 +1,157 @@
+// dct_entropy.h
+// Modo entrópico dos coeficientes DCT (ficheiros "DCTE", dct_header.h).
+//
+// Os keep_sz coeficientes de cada canal de um bloco são divididos em bandas
+// de DCTE_BAND coeficientes (a última pode ser mais curta). Cada banda tem:
+//   1 bit (0 = todos os coeficientes quantizados são zero, e mais nada);
+//   se 1: 4 bits com o expoente e do passo (passo = delta * 2^e), 4 bits com
+//   o parâmetro Rice k e os coeficientes da banda.
+// delta = 2 / (2^n_bits - 1) é o passo do modo fixo com os mesmos n_bits.
+// Cada coeficiente é quantizado com um passo uniforme centrado em zero,
+// mapeado em zig-zag (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) e escrito em
+// Golomb-Rice: o quociente z >> k em unário e os k bits de baixo. Quocientes
+// >= DCTE_ESC escrevem o unário de DCTE_ESC seguido do resto em Exp-Golomb
+// de ordem k, para os picos raros não darem códigos enormes.
+//
+// Os parâmetros são escolhidos pelo codificador bloco a bloco: e deixa
+// "precision" bits para o maior coeficiente da banda (as bandas fortes
+// ficam com passos maiores) e k é o que dá menos bits à banda.
+#ifndef DCT_ENTROPY_H
+#define DCT_ENTROPY_H
+
+#include "bit_stream.h"
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+const int DCTE_BAND = 32;
+const int DCTE_ESC = 16;
+const int DCTE_MAX_EXP = 15;
+const int DCTE_MAX_K = 15;
+const int DCTE_MAX_BITS = 24; // n_bits máximo: os coeficientes quantizados cabem em int32
+
+struct DcteBand {
+    uint8_t exp = 0;
+    uint8_t k = 0;
+    bool nonzero = false;
+};
+
+inline uint32_t dcte_zigzag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+inline int32_t dcte_unzigzag(uint32_t z) {
+    return static_cast<int32_t>(z >> 1) ^ -static_cast<int32_t>(z & 1);
+}
+
+inline double dcte_delta(int n_bits) {
+    return 2.0 / static_cast<double>((1ULL << n_bits) - 1);
+}
+
+// Bits do código de z com parâmetro k (unário + k bits, ou escape + Exp-Golomb)
+inline uint64_t dcte_rice_bits(uint32_t z, int k) {
+    uint64_t q = z >> k;
+    if (q < DCTE_ESC)
+        return q + 1 + k;
+    uint64_t w = z - (static_cast<uint64_t>(DCTE_ESC) << k) + (1ULL << k);
+    int n = 63 - __builtin_clzll(w);
+    return DCTE_ESC + 1 + 2 * n - k + 1;
+}
+
+inline void dcte_write_rice(BitStream& obs, uint32_t z, int k) {
+    uint64_t q = z >> k;
+    if (q < DCTE_ESC) {
+        obs.write_unary(q);
+        obs.write_n_bits(z, k);
+    } else {
+        obs.write_unary(DCTE_ESC);
+        obs.write_exp_golomb(k, z - (static_cast<uint64_t>(DCTE_ESC) << k));
+    }
+}
+
+// Devolve EOF (como uint64_t) se o ficheiro acabar a meio do código
+inline uint64_t dcte_read_rice(BitStream& ibs, int k) {
+    const uint64_t eof = static_cast<uint64_t>(EOF);
+    uint64_t q = ibs.read_unary();
+    if (q < DCTE_ESC) {
+        uint64_t low = ibs.read_n_bits(k);
+        return low == eof ? eof : (q << k) | low;
+    }
+    if (q != DCTE_ESC)
+        return eof;
+    uint64_t r = ibs.read_exp_golomb(k);
+    return r == eof ? eof : r + (static_cast<uint64_t>(DCTE_ESC) << k);
+}
+
+// Quantiza os n coeficientes normalizados v de uma banda para z (zig-zag) e
+// escolhe os parâmetros; precision <= 0 usa sempre o passo delta
+inline DcteBand dcte_quantize_band(const double* v, size_t n, double delta, int precision, uint32_t* z) {
+    DcteBand band;
+    double peak = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        peak = std::max(peak, std::fabs(v[i]));
+    if (precision > 0 && peak > delta) {
+        int e = static_cast<int>(std::floor(std::log2(peak / delta))) - precision + 1;
+        band.exp = static_cast<uint8_t>(std::clamp(e, 0, DCTE_MAX_EXP));
+    }
+
+    const double step = std::ldexp(delta, band.exp);
+    const double limit = static_cast<double>(1 << 30);
+    for (size_t i = 0; i < n; ++i) {
+        double qi = std::clamp(std::round(v[i] / step), -limit, limit);
+        z[i] = dcte_zigzag(static_cast<int32_t>(qi));
+        band.nonzero = band.nonzero || z[i] != 0;
+    }
+    if (!band.nonzero)
+        return band;
+
+    uint64_t best = UINT64_MAX;
+    for (int k = 0; k <= DCTE_MAX_K; ++k) {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < n; ++i)
+            bits += dcte_rice_bits(z[i], k);
+        if (bits < best) {
+            best = bits;
+            band.k = static_cast<uint8_t>(k);
+        }
+    }
+    return band;
+}
+
+inline void dcte_write_band(BitStream& obs, const DcteBand& band, const uint32_t* z, size_t n) {
+    obs.write_bit(band.nonzero);
+    if (!band.nonzero)
+        return;
+    obs.write_n_bits(band.exp, 4);
+    obs.write_n_bits(band.k, 4);
+    for (size_t i = 0; i < n; ++i)
+        dcte_write_rice(obs, z[i], band.k);
+}
+
+// Lê uma banda de n coeficientes para z e devolve o seu passo em *step;
+// false se o ficheiro acabar antes
+inline bool dcte_read_band(BitStream& ibs, double delta, uint32_t* z, size_t n, double* step) {
+    int nonzero = ibs.read_bit();
+    if (nonzero == EOF)
+        return false;
+    *step = delta;
+    if (!nonzero) {
+        std::fill(z, z + n, 0u);
+        return true;
+    }
+
+    uint64_t e = ibs.read_n_bits(4);
+    uint64_t k = ibs.read_n_bits(4);
+    if (e == static_cast<uint64_t>(EOF) || k == static_cast<uint64_t>(EOF))
+        return false;
+    *step = std::ldexp(delta, static_cast<int>(e));
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t zi = dcte_read_rice(ibs, static_cast<int>(k));
+        if (zi > UINT32_MAX)
+            return false;
+        z[i] = static_cast<uint32_t>(zi);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,408 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "dct_float.h"
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define DCT_FLOAT_X86
+#endif
+
+using namespace std;
+
+//-------------------------------------------------------------------------------------------
+//
+// Constant tables of the n-point transforms (n / 2 point FFT), computed in
+// double precision once per size
+//
+template<int N>
+struct DctTables {
+	static constexpr int M = N / 2;
+
+	int		bitrev[M];
+	float	w_re[M], w_im[M]; // FFT stage of half-size h: w[h + j] = exp(-2 pi i j / 2h)
+	float	a_re[M], a_im[M]; // exp(-2 pi i k / N), to split the FFT of the real sequence
+	float	b_re[M], b_im[M]; // exp(-i pi k / 2N), the shift of the DCT
+
+	DctTables() {
+		int log_m { };
+		while((1 << log_m) < M)
+			log_m++;
+
+		for(int m = 0 ; m < M ; m++) {
+			int r { };
+			for(int bit = 0 ; bit < log_m ; bit++)
+				r |= ((m >> bit) & 1) << (log_m - 1 - bit);
+
+			bitrev[m] = r;
+		}
+
+		for(int h = 1 ; h < M ; h <<= 1)
+			for(int j = 0 ; j < h ; j++) {
+				w_re[h + j] = float(cos(-M_PI * j / h));
+				w_im[h + j] = float(sin(-M_PI * j / h));
+			}
+
+		for(int k = 0 ; k < M ; k++) {
+			a_re[k] = float(cos(-2 * M_PI * k / N));
+			a_im[k] = float(sin(-2 * M_PI * k / N));
+			b_re[k] = float(cos(-M_PI * k / (2 * N)));
+			b_im[k] = float(sin(-M_PI * k / (2 * N)));
+		}
+	}
+
+	static const DctTables& get() {
+		static const DctTables tables;
+		return tables;
+	}
+};
+
+//-------------------------------------------------------------------------------------------
+//
+// Radix-2 FFT stages, in place, on split real/imaginary arrays whose input
+// is in bit-reversed order. The first two stages (half-sizes 1 and 2, with
+// twiddles 1 and -i) are one radix-4 pass; the scalar kernel does the
+// stages of half-size h_first .. h_end - 1. The AVX2/FMA kernels do the
+// stage of half-size 4 two groups at a time and the others 8 points at a time
+//
+template<int M>
+static void fft_radix4_first(float* re, float* im) {
+	for(int base = 0 ; base < M ; base += 4) {
+		float* r = re + base;
+		float* i = im + base;
+		float ar = r[0] + r[1], ai = i[0] + i[1], br = r[0] - r[1], bi = i[0] - i[1];
+		float cr = r[2] + r[3], ci = i[2] + i[3], dr = r[2] - r[3], di = i[2] - i[3];
+		r[0] = ar + cr;
+		i[0] = ai + ci;
+		r[2] = ar - cr;
+		i[2] = ai - ci;
+		r[1] = br + di; // b + (-i) d
+		i[1] = bi - dr;
+		r[3] = br - di;
+		i[3] = bi + dr;
+	}
+}
+
+template<int M>
+static void fft_stages_scalar(float* re, float* im, const float* w_re, const float* w_im,
+  int h_first, int h_end) {
+	for(int h = h_first ; h < h_end ; h <<= 1)
+		for(int base = 0 ; base < M ; base += 2 * h)
+			for(int j = 0 ; j < h ; j++) {
+				float* r0 = re + base + j;
+				float* i0 = im + base + j;
+				float tr = w_re[h + j] * r0[h] - w_im[h + j] * i0[h];
+				float ti = w_re[h + j] * i0[h] + w_im[h + j] * r0[h];
+				r0[h] = r0[0] - tr;
+				i0[h] = i0[0] - ti;
+				r0[0] += tr;
+				i0[0] += ti;
+			}
+}
+
+#ifdef DCT_FLOAT_X86
+
+template<int M>
+__attribute__((target("avx2,fma")))
+static void fft_stage4_avx2(float* re, float* im, const float* w_re, const float* w_im) {
+	const __m256 wr = _mm256_broadcast_ps((const __m128*)(w_re + 4));
+	const __m256 wi = _mm256_broadcast_ps((const __m128*)(w_im + 4));
+	for(int base = 0 ; base < M ; base += 16) {
+		float* r0 = re + base;
+		float* i0 = im + base;
+		__m256 ur = _mm256_set_m128(_mm_loadu_ps(r0 + 8), _mm_loadu_ps(r0));
+		__m256 ui = _mm256_set_m128(_mm_loadu_ps(i0 + 8), _mm_loadu_ps(i0));
+		__m256 xr = _mm256_set_m128(_mm_loadu_ps(r0 + 12), _mm_loadu_ps(r0 + 4));
+		__m256 xi = _mm256_set_m128(_mm_loadu_ps(i0 + 12), _mm_loadu_ps(i0 + 4));
+		__m256 tr = _mm256_fmsub_ps(wr, xr, _mm256_mul_ps(wi, xi));
+		__m256 ti = _mm256_fmadd_ps(wr, xi, _mm256_mul_ps(wi, xr));
+		__m256 sr = _mm256_add_ps(ur, tr), si = _mm256_add_ps(ui, ti);
+		__m256 dr = _mm256_sub_ps(ur, tr), di = _mm256_sub_ps(ui, ti);
+		_mm_storeu_ps(r0, _mm256_castps256_ps128(sr));
+		_mm_storeu_ps(r0 + 8, _mm256_extractf128_ps(sr, 1));
+		_mm_storeu_ps(i0, _mm256_castps256_ps128(si));
+		_mm_storeu_ps(i0 + 8, _mm256_extractf128_ps(si, 1));
+		_mm_storeu_ps(r0 + 4, _mm256_castps256_ps128(dr));
+		_mm_storeu_ps(r0 + 12, _mm256_extractf128_ps(dr, 1));
+		_mm_storeu_ps(i0 + 4, _mm256_castps256_ps128(di));
+		_mm_storeu_ps(i0 + 12, _mm256_extractf128_ps(di, 1));
+	}
+}
+
+template<int M>
+__attribute__((target("avx2,fma")))
+static void fft_stages_avx2(float* re, float* im, const float* w_re, const float* w_im) {
+	for(int h = 8 ; h < M ; h <<= 1)
+		for(int base = 0 ; base < M ; base += 2 * h)
+			for(int j = 0 ; j < h ; j += 8) {
+				float* r0 = re + base + j;
+				float* i0 = im + base + j;
+				__m256 wr = _mm256_loadu_ps(w_re + h + j);
+				__m256 wi = _mm256_loadu_ps(w_im + h + j);
+				__m256 xr = _mm256_loadu_ps(r0 + h);
+				__m256 xi = _mm256_loadu_ps(i0 + h);
+				__m256 tr = _mm256_fmsub_ps(wr, xr, _mm256_mul_ps(wi, xi));
+				__m256 ti = _mm256_fmadd_ps(wr, xi, _mm256_mul_ps(wi, xr));
+				__m256 ur = _mm256_loadu_ps(r0);
+				__m256 ui = _mm256_loadu_ps(i0);
+				_mm256_storeu_ps(r0 + h, _mm256_sub_ps(ur, tr));
+				_mm256_storeu_ps(i0 + h, _mm256_sub_ps(ui, ti));
+				_mm256_storeu_ps(r0, _mm256_add_ps(ur, tr));
+				_mm256_storeu_ps(i0, _mm256_add_ps(ui, ti));
+			}
+}
+
+#endif
+
+template<int M, bool AVX2>
+static void fft(float* re, float* im, const float* w_re, const float* w_im) {
+	fft_radix4_first<M>(re, im);
+#ifdef DCT_FLOAT_X86
+	if constexpr(AVX2) {
+		fft_stage4_avx2<M>(re, im, w_re, w_im);
+		fft_stages_avx2<M>(re, im, w_re, w_im);
+		return;
+	}
+#endif
+	fft_stages_scalar<M>(re, im, w_re, w_im, 4, M);
+}
+
+#ifdef DCT_FLOAT_X86
+
+//-------------------------------------------------------------------------------------------
+//
+// AVX2/FMA twiddle passes of the DCTs (below), for k = 8 .. M - 1, 8 at a
+// time: the terms in M - k and N - k are loaded and stored reversed
+//
+__attribute__((target("avx2,fma")))
+static inline __m256 reverse8(__m256 v) {
+	return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 load8(const double* p) {
+	return _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(p + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(p)));
+}
+
+__attribute__((target("avx2,fma")))
+static inline void store8(double* p, __m256 v) {
+	_mm256_storeu_pd(p, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+	_mm256_storeu_pd(p + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+template<int N>
+__attribute__((target("avx2,fma")))
+static void forward_twiddle_avx2(const float* re, const float* im, double* X, const DctTables<N>& t) {
+	constexpr int M = N / 2;
+	for(int k = 8 ; k < M ; k += 8) {
+		__m256 zr = _mm256_loadu_ps(re + k), zi = _mm256_loadu_ps(im + k);
+		__m256 cr = reverse8(_mm256_loadu_ps(re + M - k - 7));
+		__m256 ci = reverse8(_mm256_loadu_ps(im + M - k - 7));
+		__m256 ar = _mm256_loadu_ps(t.a_re + k), ai = _mm256_loadu_ps(t.a_im + k);
+		__m256 br = _mm256_loadu_ps(t.b_re + k), bi = _mm256_loadu_ps(t.b_im + k);
+		__m256 er = _mm256_add_ps(zr, cr), ei = _mm256_sub_ps(zi, ci);
+		__m256 or_ = _mm256_add_ps(zi, ci), oi = _mm256_sub_ps(cr, zr);
+		__m256 vr = _mm256_fnmadd_ps(ai, oi, _mm256_fmadd_ps(ar, or_, er));
+		__m256 vi = _mm256_fmadd_ps(ai, or_, _mm256_fmadd_ps(ar, oi, ei));
+		store8(X + k, _mm256_fmsub_ps(br, vr, _mm256_mul_ps(bi, vi)));
+		store8(X + N - k - 7, reverse8(_mm256_fnmsub_ps(br, vi, _mm256_mul_ps(bi, vr))));
+	}
+}
+
+template<int N>
+__attribute__((target("avx2,fma")))
+static void inverse_twiddle_avx2(const double* X, float* re, float* im, const DctTables<N>& t) {
+	constexpr int M = N / 2;
+	alignas(32) float zr[8], zi[8];
+	for(int k = 8 ; k < M ; k += 8) {
+		// Twice V[k] and twice V[M-k] (reversed)
+		__m256 br = _mm256_loadu_ps(t.b_re + k), bi = _mm256_loadu_ps(t.b_im + k);
+		__m256 xr = load8(X + k), xi = reverse8(load8(X + N - k - 7));
+		__m256 vr = _mm256_fmsub_ps(br, xr, _mm256_mul_ps(bi, xi));
+		__m256 vi = _mm256_fnmsub_ps(br, xi, _mm256_mul_ps(bi, xr));
+		__m256 cbr = reverse8(_mm256_loadu_ps(t.b_re + M - k - 7));
+		__m256 cbi = reverse8(_mm256_loadu_ps(t.b_im + M - k - 7));
+		__m256 cxr = reverse8(load8(X + M - k - 7)), cxi = load8(X + M + k);
+		__m256 cr = _mm256_fmsub_ps(cbr, cxr, _mm256_mul_ps(cbi, cxi));
+		__m256 ci = _mm256_fnmsub_ps(cbr, cxi, _mm256_mul_ps(cbi, cxr));
+
+		__m256 ar = _mm256_loadu_ps(t.a_re + k), ai = _mm256_loadu_ps(t.a_im + k);
+		__m256 er = _mm256_add_ps(vr, cr), ei = _mm256_sub_ps(vi, ci);
+		__m256 dr = _mm256_sub_ps(vr, cr), di = _mm256_add_ps(vi, ci);
+		__m256 or_ = _mm256_fmadd_ps(ar, dr, _mm256_mul_ps(ai, di));
+		__m256 oi = _mm256_fmsub_ps(ar, di, _mm256_mul_ps(ai, dr));
+		_mm256_store_ps(zr, _mm256_sub_ps(er, oi));
+		_mm256_store_ps(zi, _mm256_xor_ps(_mm256_add_ps(ei, or_), _mm256_set1_ps(-0.0f)));
+		for(int j = 0 ; j < 8 ; j++) {
+			re[t.bitrev[k + j]] = zr[j];
+			im[t.bitrev[k + j]] = zi[j];
+		}
+	}
+}
+
+#endif
+
+//-------------------------------------------------------------------------------------------
+//
+// DCT-II (REDFT10). With v[n] = x[2n] and v[N-1-n] = x[2n+1], n < N/2, and
+// V its DFT, X[k] = 2 Re(b_k V[k]) and X[N-k] = -2 Im(b_k V[k]). V comes
+// from the M-point FFT Z of z[m] = v[2m] + i v[2m+1]:
+// V[k] = (Z[k] + Z*[M-k]) / 2 + a_k (Z[k] - Z*[M-k]) / 2i
+//
+template<int N, bool AVX2>
+static void forward_rows(const double* in, double* out, int howmany, float* re, float* im) {
+	constexpr int M = N / 2;
+	const DctTables<N>& t = DctTables<N>::get();
+	for(int row = 0 ; row < howmany ; row++) {
+		const double* x = in + row * N;
+		double* X = out + row * N;
+
+		for(int m = 0 ; m < M / 2 ; m++) {
+			re[t.bitrev[m]] = float(x[4 * m]);
+			im[t.bitrev[M - 1 - m]] = float(x[4 * m + 1]);
+			im[t.bitrev[m]] = float(x[4 * m + 2]);
+			re[t.bitrev[M - 1 - m]] = float(x[4 * m + 3]);
+		}
+
+		fft<M, AVX2>(re, im, t.w_re, t.w_im);
+
+		X[0] = 2.0 * (double(re[0]) + im[0]);
+		X[M] = M_SQRT2 * (double(re[0]) - im[0]);
+		int k_end = M;
+#ifdef DCT_FLOAT_X86
+		if constexpr(AVX2) {
+			forward_twiddle_avx2<N>(re, im, X, t);
+			k_end = 8;
+		}
+#endif
+		for(int k = 1 ; k < k_end ; k++) {
+			// Twice E and O: the sum and the difference (over i) with Z*[M-k]
+			float er = re[k] + re[M - k], ei = im[k] - im[M - k];
+			float or_ = im[k] + im[M - k], oi = re[M - k] - re[k];
+			float vr = er + t.a_re[k] * or_ - t.a_im[k] * oi;
+			float vi = ei + t.a_re[k] * oi + t.a_im[k] * or_;
+			X[k] = t.b_re[k] * vr - t.b_im[k] * vi;
+			X[N - k] = -(t.b_re[k] * vi + t.b_im[k] * vr);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// DCT-III (REDFT01), 2N times the inverse of the DCT-II: V[k] = b*_k (X[k] -
+// i X[N-k]) / 2, Z[k] = E[k] + i O[k] with E[k] = (V[k] + V*[M-k]) / 2 and
+// O[k] = a*_k (V[k] - V*[M-k]) / 2, and z is the inverse FFT of Z (done as
+// the conjugate of the FFT of Z*)
+//
+template<int N, bool AVX2>
+static void inverse_rows(const double* in, double* out, int howmany, float* re, float* im) {
+	constexpr int M = N / 2;
+	const DctTables<N>& t = DctTables<N>::get();
+	for(int row = 0 ; row < howmany ; row++) {
+		const double* X = in + row * N;
+		double* x = out + row * N;
+
+		// Twice V[k] (k > 0); V[0] and V[M] are real
+		auto v = [&](int k, float& vr, float& vi) {
+			float xr = float(X[k]), xi = -float(X[N - k]);
+			vr = t.b_re[k] * xr + t.b_im[k] * xi;
+			vi = t.b_re[k] * xi - t.b_im[k] * xr;
+		};
+
+		// Z (4 times), conjugated, into bit-reversed order
+		float v0r = float(X[0]), vmr = float(M_SQRT2 * X[M]);
+		re[0] = v0r + vmr;
+		im[0] = -(v0r - vmr);
+		int k_end = M;
+#ifdef DCT_FLOAT_X86
+		if constexpr(AVX2) {
+			inverse_twiddle_avx2<N>(X, re, im, t);
+			k_end = 8;
+		}
+#endif
+		for(int k = 1 ; k < k_end ; k++) {
+			float vr, vi, cr, ci;
+			v(k, vr, vi);
+			v(M - k, cr, ci);
+			float er = vr + cr, ei = vi - ci;
+			float dr = vr - cr, di = vi + ci;
+			float or_ = t.a_re[k] * dr + t.a_im[k] * di;
+			float oi = t.a_re[k] * di - t.a_im[k] * dr;
+			re[t.bitrev[k]] = er - oi;
+			im[t.bitrev[k]] = -(ei + or_);
+		}
+
+		fft<M, AVX2>(re, im, t.w_re, t.w_im);
+
+		// x[2n] = v[n] and x[2n+1] = v[N-1-n], with v[2m] + i v[2m+1] = z[m]
+		for(int m = 0 ; m < M / 2 ; m++) {
+			x[4 * m] = re[m];
+			x[4 * m + 1] = -im[M - 1 - m];
+			x[4 * m + 2] = -im[m];
+			x[4 * m + 3] = re[M - 1 - m];
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+
+static bool has_avx2() {
+#ifdef DCT_FLOAT_X86
+	static const bool avx2 = __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma");
+	return avx2;
+#else
+	return false;
+#endif
+}
+
+template<int N>
+static void set_kernel(bool inverse, void (*&kernel)(const double*, double*, int, float*, float*)) {
+	if(has_avx2())
+		kernel = inverse ? inverse_rows<N, true> : forward_rows<N, true>;
+	else
+		kernel = inverse ? inverse_rows<N, false> : forward_rows<N, false>;
+}
+
+DctFloat::DctFloat(int n, int howmany, bool inverse) : m_howmany { howmany },
+  m_re(n / 2), m_im(n / 2) {
+	switch(n) {
+		case 256: set_kernel<256>(inverse, m_kernel); break;
+		case 512: set_kernel<512>(inverse, m_kernel); break;
+		case 1024: set_kernel<1024>(inverse, m_kernel); break;
+		case 2048: set_kernel<2048>(inverse, m_kernel); break;
+	}
+}
+
+bool DctFloat::supports(int n) {
+	return n == 256 or n == 512 or n == 1024 or n == 2048;
+}
+
+const char* DctFloat::kernel_name() {
+	return has_avx2() ? "avx2" : "scalar";
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Transforms the "howmany" rows of "in" into "out" (which may be "in": each
+// row is read in full before it is written)
+//
+void DctFloat::execute(const double* in, double* out) {
+	if(m_kernel != nullptr)
+		m_kernel(in, out, m_howmany, m_re.data(), m_im.data());
+}
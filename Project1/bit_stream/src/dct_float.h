@@ -0,0 +1,52 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef DCT_FLOAT_H
+#define DCT_FLOAT_H
+
+#include <vector>
+
+//-------------------------------------------------------------------------------------------
+//
+// Single-precision DCT engine, an alternative to FFTW for the block sizes
+// of the DCT tools (256, 512, 1024 and 2048 points). It computes the same
+// transforms as FFTW's REDFT10 (DCT-II) and REDFT01 (DCT-III), with the
+// same scaling, on "howmany" contiguous rows of n points. The rows are
+// given and returned in double precision, but transformed in float: each
+// n-point DCT is an n/2-point complex FFT between a reordering pass and a
+// twiddle pass. Every size is compiled as its own specialisation; the FFT
+// runs on AVX2/FMA kernels when the CPU has them, on scalar code otherwise.
+//
+class DctFloat {
+  private:
+	typedef void (*Kernel)(const double* in, double* out, int howmany, float* re, float* im);
+
+	int					m_howmany;
+	Kernel				m_kernel { };
+	std::vector<float>	m_re, m_im; // Work area of the FFT
+
+  public:
+	DctFloat(int n, int howmany, bool inverse);
+
+	static bool supports(int n);
+	static const char* kernel_name();
+
+	void execute(const double* in, double* out);
+};
+
+#endif
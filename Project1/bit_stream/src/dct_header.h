@@ -0,0 +1,73 @@
+// dct_header.h
+// Cabeçalho dos ficheiros .enc do DCT_enc_Wav (formato "DCT2"): tudo o que o
+// descodificador precisa, incluindo o número de canais.
+//
+// Layout (little-endian, 28 bytes):
+//   "DCT2" | uint16 bs | uint16 keep_sz | uint16 channels | uint16 n_bits |
+//   uint32 sample_rate | uint16 orig_bits | uint16 n_lanes (0 = um só stream) |
+//   uint64 frames
+// Seguem-se os blocos por ordem; cada bloco tem, canal a canal, os keep_sz
+// coeficientes quantizados (n_bits cada). Com n_lanes > 0 vem o contentor
+// multi-lane (bloco b na lane b % n_lanes). O ficheiro acaba com o índice
+// de blocos (trailer de bit_index.h): a posição em bits, no stream ou na sua
+// lane, de um bloco em cada 16.
+//
+// O modo entrópico (magic "DCTE", mesmo layout) guarda os coeficientes com
+// passos por banda e códigos Golomb-Rice (dct_entropy.h); n_bits dá o passo
+// base e os blocos têm tamanho variável.
+//
+// Os ficheiros antigos ("DCT1" e "DCTL") têm só magic, bs e keep_sz (8 bytes)
+// e apenas o canal 0.
+#ifndef DCT_HEADER_H
+#define DCT_HEADER_H
+
+#include <cstdint>
+#include <iostream>
+
+const uint32_t DCT1_MAGIC = 0x44435431; // "DCT1"
+const uint32_t DCTL_MAGIC = 0x4443544C; // "DCTL"
+
+struct DctHeader {
+    static const uint32_t MAGIC = 0x32544344; // "DCT2"
+    static const uint32_t ENTROPY_MAGIC = 0x45544344; // "DCTE"
+    static const int SIZE = 28;
+
+    uint16_t bs = 0;
+    uint16_t keep_sz = 0;
+    uint16_t channels = 0;
+    uint16_t n_bits = 0;
+    uint32_t sample_rate = 0;
+    uint16_t orig_bits = 16;
+    uint16_t n_lanes = 0;
+    uint64_t frames = 0;
+    bool entropy = false; // "DCTE": não é escrito, vem do magic
+
+    bool write(std::ostream &os) const {
+        uint32_t magic = entropy ? ENTROPY_MAGIC : MAGIC;
+        os.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        os.write(reinterpret_cast<const char*>(&bs), sizeof(bs));
+        os.write(reinterpret_cast<const char*>(&keep_sz), sizeof(keep_sz));
+        os.write(reinterpret_cast<const char*>(&channels), sizeof(channels));
+        os.write(reinterpret_cast<const char*>(&n_bits), sizeof(n_bits));
+        os.write(reinterpret_cast<const char*>(&sample_rate), sizeof(sample_rate));
+        os.write(reinterpret_cast<const char*>(&orig_bits), sizeof(orig_bits));
+        os.write(reinterpret_cast<const char*>(&n_lanes), sizeof(n_lanes));
+        os.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+        return os.good();
+    }
+
+    // Lê o resto do cabeçalho, depois do magic "DCT2"/"DCTE"; devolve false se for inválido
+    bool read(std::istream &is) {
+        is.read(reinterpret_cast<char*>(&bs), sizeof(bs));
+        is.read(reinterpret_cast<char*>(&keep_sz), sizeof(keep_sz));
+        is.read(reinterpret_cast<char*>(&channels), sizeof(channels));
+        is.read(reinterpret_cast<char*>(&n_bits), sizeof(n_bits));
+        is.read(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
+        is.read(reinterpret_cast<char*>(&orig_bits), sizeof(orig_bits));
+        is.read(reinterpret_cast<char*>(&n_lanes), sizeof(n_lanes));
+        is.read(reinterpret_cast<char*>(&frames), sizeof(frames));
+        return is.good() && bs != 0 && keep_sz <= bs && channels != 0 && n_bits >= 1 && n_bits <= 32;
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dct_plan.h"
+
+using namespace std;
+
+//-------------------------------------------------------------------------------------------
+
+static string default_wisdom_path() {
+	if(const char* path = getenv("DCT_WISDOM"); path != nullptr and *path != '\0')
+		return path;
+
+	string dir;
+	if(const char* xdg = getenv("XDG_CACHE_HOME"); xdg != nullptr and *xdg != '\0')
+		dir = xdg;
+	else if(const char* home = getenv("HOME"); home != nullptr and *home != '\0')
+		dir = string(home) + "/.cache";
+	else
+		return "";
+
+	return dir + "/ic_dct/fftw.wisdom";
+}
+
+// Creates the missing directories of "path" (but not the file itself)
+static void make_parent_dirs(const string& path) {
+	for(size_t pos = path.find('/', 1) ; pos != string::npos ; pos = path.find('/', pos + 1))
+		mkdir(path.substr(0, pos).c_str(), 0755);
+}
+
+//-------------------------------------------------------------------------------------------
+
+DctPlanner::DctPlanner() : m_wisdom_path { default_wisdom_path() } {
+	if(not m_wisdom_path.empty())
+		m_has_wisdom = fftw_import_wisdom_from_filename(m_wisdom_path.c_str()) != 0;
+}
+
+const string& DctPlanner::wisdom_path() const {
+	return m_wisdom_path;
+}
+
+bool DctPlanner::has_wisdom() const {
+	return m_has_wisdom;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// A plan from the wisdom, at the best rigor there is, or else an estimated
+// one. Wisdom-only planning never measures, so "in" and "out" are kept
+//
+static fftw_plan plan_from_wisdom(bool has_wisdom, const function<fftw_plan(unsigned)>& plan) {
+	if(has_wisdom)
+		for(unsigned rigor : { FFTW_EXHAUSTIVE, FFTW_PATIENT, FFTW_MEASURE })
+			if(fftw_plan p = plan(rigor | FFTW_WISDOM_ONLY); p != nullptr)
+				return p;
+
+	return plan(FFTW_ESTIMATE);
+}
+
+fftw_plan DctPlanner::plan_r2r_1d(int n, double* in, double* out, fftw_r2r_kind kind) {
+	return plan_from_wisdom(m_has_wisdom, [&](unsigned flags) {
+		return fftw_plan_r2r_1d(n, in, out, kind, flags); });
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// "howmany" transforms of n points, on consecutive rows of in/out
+//
+fftw_plan DctPlanner::plan_many_r2r(int n, int howmany, double* in, double* out, fftw_r2r_kind kind) {
+	return plan_from_wisdom(m_has_wisdom, [&](unsigned flags) {
+		return fftw_plan_many_r2r(1, &n, howmany, in, nullptr, 1, n, out, nullptr, 1, n, &kind, flags); });
+}
+
+//-------------------------------------------------------------------------------------------
+
+int dct_batch_blocks(int n, int channels) {
+	long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if(l2 <= 0)
+		l2 = 256 * 1024;
+
+	long rows = l2 / (2 * n * static_cast<long>(sizeof(double))); // Input and output
+	return static_cast<int>(clamp(rows / max(channels, 1), 1L, 64L));
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Measures the DCT-II and DCT-III of each size, in place and out of place
+// (as the tools use them), one block at a time and in the default batches
+// for mono and stereo, and saves the wisdom
+//
+bool DctPlanner::train(const vector<int>& sizes, unsigned flags) {
+	if(m_wisdom_path.empty())
+		return false;
+
+	for(int n : sizes) {
+		for(int howmany : { dct_batch_blocks(n, 1), 2 * dct_batch_blocks(n, 2) }) {
+			DctVector in(static_cast<size_t>(n) * howmany), out(in.size());
+			for(fftw_r2r_kind kind : { FFTW_REDFT10, FFTW_REDFT01 }) {
+				fftw_destroy_plan(fftw_plan_many_r2r(1, &n, howmany, in.data(), nullptr, 1, n,
+				  out.data(), nullptr, 1, n, &kind, flags));
+				fftw_destroy_plan(fftw_plan_many_r2r(1, &n, howmany, in.data(), nullptr, 1, n,
+				  in.data(), nullptr, 1, n, &kind, flags));
+			}
+		}
+
+		DctVector in(n), out(n);
+		for(fftw_r2r_kind kind : { FFTW_REDFT10, FFTW_REDFT01 }) {
+			fftw_destroy_plan(fftw_plan_r2r_1d(n, in.data(), out.data(), kind, flags));
+			fftw_destroy_plan(fftw_plan_r2r_1d(n, in.data(), in.data(), kind, flags));
+		}
+	}
+
+	make_parent_dirs(m_wisdom_path);
+	m_has_wisdom = fftw_export_wisdom_to_filename(m_wisdom_path.c_str()) != 0;
+	return m_has_wisdom;
+}
+
+//-------------------------------------------------------------------------------------------
+
+int dct_train_wisdom_option(int argc, char* argv[]) {
+	int opt { };
+	for(int n = 1 ; n < argc ; n++)
+		if(strcmp(argv[n], "--train-wisdom") == 0)
+			opt = n;
+
+	if(opt == 0)
+		return -1;
+
+	vector<int> sizes;
+	for(int n = opt + 1 ; n < argc and argv[n][0] != '-' ; n++)
+		sizes.push_back(atoi(argv[n]));
+
+	if(sizes.empty())
+		sizes = { 256, 512, 1024, 2048, 4096 };
+
+	DctPlanner planner;
+	cerr << "Training FFTW wisdom (this may take a while)...\n";
+	if(not planner.train(sizes)) {
+		cerr << "Error: could not write wisdom to \"" << planner.wisdom_path() << "\"\n";
+		return 1;
+	}
+
+	cerr << "Wisdom saved to " << planner.wisdom_path() << '\n';
+	return 0;
+}
@@ -0,0 +1,94 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef DCT_PLAN_H
+#define DCT_PLAN_H
+
+#include <string>
+#include <vector>
+#include <new>
+#include <fftw3.h>
+
+//-------------------------------------------------------------------------------------------
+//
+// Plan manager for the DCT tools. FFTW wisdom is kept in a cache file
+// ($DCT_WISDOM or, by default, $XDG_CACHE_HOME/ic_dct/fftw.wisdom, with
+// $HOME/.cache when XDG_CACHE_HOME is not set). Plans are made from that
+// wisdom, with the rigor it was trained at (FFTW_MEASURE or better), so
+// that repeat runs get the measured kernels without planning cost. Problems
+// with no wisdom fall back to FFTW_ESTIMATE. train() measures the usual
+// problems once (FFTW_PATIENT by default) and saves the wisdom.
+//
+// Wisdom depends on the alignment of the arrays, so the buffers given to
+// the plans should be DctVectors (allocated by FFTW).
+//
+// The tools transform K blocks (all channels) at a time with one batched
+// plan: the rows of a contiguous matrix, n points each. By default K is
+// such that the input and output matrices fit in the L2 cache.
+//
+template<typename T>
+struct FftwAllocator {
+	typedef T value_type;
+
+	FftwAllocator() = default;
+	template<typename U> FftwAllocator(const FftwAllocator<U>&) { }
+
+	T* allocate(size_t n) {
+		void* p = fftw_malloc(n * sizeof(T));
+		if(p == nullptr)
+			throw std::bad_alloc();
+
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t) {
+		fftw_free(p);
+	}
+
+	template<typename U> bool operator==(const FftwAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const FftwAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<double, FftwAllocator<double>> DctVector;
+
+class DctPlanner {
+  private:
+	std::string	m_wisdom_path;
+	bool		m_has_wisdom { };
+
+  public:
+	DctPlanner();
+
+	const std::string& wisdom_path() const;
+	bool has_wisdom() const;
+
+	// Plans are not thread-safe: make them all on one thread
+	fftw_plan plan_r2r_1d(int n, double* in, double* out, fftw_r2r_kind kind);
+	fftw_plan plan_many_r2r(int n, int howmany, double* in, double* out, fftw_r2r_kind kind);
+
+	bool train(const std::vector<int>& sizes, unsigned flags = FFTW_PATIENT);
+};
+
+// Blocks of n points and "channels" channels per batched transform
+int dct_batch_blocks(int n, int channels);
+
+// Handles "--train-wisdom [ size ... ]" on the command line of a DCT tool;
+// returns -1 if the option is not there, otherwise the exit status
+int dct_train_wisdom_option(int argc, char* argv[]);
+
+#endif
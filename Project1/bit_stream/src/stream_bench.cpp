@@ -0,0 +1,312 @@
+//------------------------------------------------------------------------------
+//
+// Benchmark harness for the BitStream/ByteStream primitives. Each case is
+// run against every target (files in each -dir, e.g. a disk and a tmpfs,
+// and the in-memory backends), with warmup runs and repetitions. Results
+// go to stdout as a table and, with -csv, to a machine-readable file.
+//
+//------------------------------------------------------------------------------
+//
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <sys/stat.h>
+#include "bit_stream.h"
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+
+struct Target {
+	string	name;
+	string	path; // Empty for the in-memory backends
+};
+
+struct Result {
+	double	seconds;
+	double	bits;
+};
+
+typedef function<Result(const Target&)> BenchFn;
+
+static vector<uint64_t> values;
+static vector<uint16_t> values16;
+static vector<string> strings;
+
+static double elapsed(chrono::steady_clock::time_point t0) {
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+//------------------------------------------------------------------------------
+//
+// Writes with "body" to the target, timing the body and/or the final
+// flush/close
+//
+static Result run_write(const Target& target, const function<double(BitStream&)>& body,
+  bool time_body, bool time_close) {
+	vector<uint8_t> mem;
+	BitStream obs = target.path.empty() ? BitStream { mem } : BitStream { target.path, STREAM_WRITE };
+	double bits { };
+	auto t0 = chrono::steady_clock::now();
+	bits = body(obs);
+	double t_body = elapsed(t0);
+	t0 = chrono::steady_clock::now();
+	obs.close();
+	double t_close = elapsed(t0);
+	return { (time_body ? t_body : 0) + (time_close ? t_close : 0), bits };
+}
+
+//------------------------------------------------------------------------------
+//
+// Prepares the target with "prepare" (untimed), then times "body" on a
+// reader; "mapped" selects the mmap backend for files
+//
+static vector<uint8_t> mem_data;
+
+static Result run_read(const Target& target, const function<double(BitStream&)>& prepare,
+  const function<double(BitStream&)>& body, bool mapped) {
+	mem_data.clear();
+	if(target.path.empty()) {
+		BitStream obs { mem_data };
+		prepare(obs);
+		obs.close();
+	} else {
+		fstream fs { target.path, ios::out | ios::binary };
+		BitStream obs { fs, STREAM_WRITE };
+		prepare(obs);
+		obs.close();
+	}
+
+	fstream fs;
+	if(not target.path.empty() and not mapped)
+		fs.open(target.path, ios::in | ios::binary);
+
+	auto t0 = chrono::steady_clock::now();
+	double bits { };
+	if(target.path.empty()) {
+		BitStream ibs { span<const uint8_t>(mem_data) };
+		bits = body(ibs);
+	} else if(mapped) {
+		BitStream ibs { target.path };
+		bits = body(ibs);
+		ibs.close();
+	} else {
+		BitStream ibs { fs, STREAM_READ };
+		bits = body(ibs);
+		ibs.close();
+	}
+
+	return { elapsed(t0), bits };
+}
+
+//------------------------------------------------------------------------------
+
+static double write_values(BitStream& obs, int n_bits) {
+	for(uint64_t v : values)
+		obs.write_n_bits(v, n_bits);
+
+	return static_cast<double>(values.size()) * n_bits;
+}
+
+static double read_values(BitStream& ibs, int n_bits) {
+	uint64_t sum { };
+	for(size_t i = 0 ; i < values.size() ; i++)
+		sum += ibs.read_n_bits(n_bits);
+
+	if(sum == 1) // Keeps the loop from being optimised away
+		cerr << "";
+
+	return static_cast<double>(values.size()) * n_bits;
+}
+
+static double write_single_bits(BitStream& obs) {
+	for(uint64_t v : values)
+		obs.write_bit(v & 1);
+
+	return static_cast<double>(values.size());
+}
+
+static double read_single_bits(BitStream& ibs) {
+	int sum { };
+	for(size_t i = 0 ; i < values.size() ; i++)
+		sum += ibs.read_bit();
+
+	if(sum == 1)
+		cerr << "";
+
+	return static_cast<double>(values.size());
+}
+
+static double write_strings(BitStream& obs) {
+	double bits { };
+	for(const string& s : strings) {
+		obs.write_string(s);
+		bits += 8.0 * (s.size() + 1);
+	}
+
+	return bits;
+}
+
+static double read_strings(BitStream& ibs) {
+	double bits { };
+	for(size_t i = 0 ; i < strings.size() ; i++)
+		bits += 8.0 * (ibs.read_string().size() + 1);
+
+	return bits;
+}
+
+static double write_golomb(BitStream& obs) {
+	for(uint64_t v : values)
+		obs.write_exp_golomb(2, v & 0xff);
+
+	return static_cast<double>(obs.tell_bit());
+}
+
+static double read_golomb(BitStream& ibs) {
+	uint64_t sum { };
+	for(size_t i = 0 ; i < values.size() ; i++)
+		sum += ibs.read_exp_golomb(2);
+
+	if(sum == 1)
+		cerr << "";
+
+	return static_cast<double>(ibs.tell_bit());
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+
+	size_t n_values { 1 << 22 };
+	int n_reps { 5 };
+	int n_warmup { 1 };
+	string csv_path;
+	vector<string> dirs;
+
+	if(argc > 1 and string(argv[1]) == "-h") {
+		cerr << "Usage: stream_bench [ -n values (def 4194304) ]\n";
+		cerr << "                    [ -reps repetitions (def 5) ]\n";
+		cerr << "                    [ -warmup runs (def 1) ]\n";
+		cerr << "                    [ -dir directory ] ... (def /tmp and /dev/shm)\n";
+		cerr << "                    [ -csv results.csv ]\n";
+		return 1;
+	}
+
+	for(int n = 1 ; n + 1 < argc ; n++) {
+		string opt { argv[n] };
+		if(opt == "-n")
+			n_values = stoul(argv[n+1]);
+		else if(opt == "-reps")
+			n_reps = max(1, stoi(argv[n+1]));
+		else if(opt == "-warmup")
+			n_warmup = max(0, stoi(argv[n+1]));
+		else if(opt == "-dir")
+			dirs.push_back(argv[n+1]);
+		else if(opt == "-csv")
+			csv_path = argv[n+1];
+	}
+
+	if(dirs.empty()) {
+		struct stat st;
+		dirs.push_back("/tmp");
+		if(stat("/dev/shm", &st) == 0 and S_ISDIR(st.st_mode))
+			dirs.push_back("/dev/shm");
+	}
+
+	vector<Target> targets { { "mem", "" } };
+	for(const string& dir : dirs)
+		targets.push_back({ dir, dir + "/stream_bench.bin" });
+
+	mt19937_64 rng { 2025 };
+	values.resize(n_values);
+	for(auto& v : values)
+		v = rng();
+
+	values16.assign(values.begin(), values.end());
+	for(size_t bits { } ; bits < 64.0 * n_values ; ) { // Same payload size as 64-bit values
+		string s(rng() % 120, ' ');
+		for(char& c : s)
+			c = 'A' + rng() % 26;
+
+		bits += 8 * (s.size() + 1);
+		strings.push_back(s);
+	}
+
+	vector<pair<string, BenchFn>> cases;
+	cases.push_back({ "write_bit", [](const Target& t) {
+		return run_write(t, write_single_bits, true, true); } });
+	for(int w : { 1, 4, 8, 13, 16, 24, 32, 64 })
+		cases.push_back({ "write_n_bits/" + to_string(w), [w](const Target& t) {
+			return run_write(t, [w](BitStream& obs) { return write_values(obs, w); }, true, true); } });
+	for(int w : { 8, 12, 16 })
+		cases.push_back({ "pack/" + to_string(w), [w](const Target& t) {
+			return run_write(t, [w](BitStream& obs) {
+				bit_pack_fn(w)(obs, values16);
+				return static_cast<double>(values16.size()) * w; }, true, true); } });
+	cases.push_back({ "flush_close", [](const Target& t) {
+		return run_write(t, [](BitStream& obs) { return write_values(obs, 16); }, false, true); } });
+	cases.push_back({ "read_bit", [](const Target& t) {
+		return run_read(t, write_single_bits, read_single_bits, false); } });
+	for(bool mapped : { false, true })
+		for(int w : { 1, 8, 16, 32, 64 })
+			cases.push_back({ string(mapped ? "read_n_bits_mmap/" : "read_n_bits/") + to_string(w),
+			  [w, mapped](const Target& t) {
+				return run_read(t, [w](BitStream& obs) { return write_values(obs, w); },
+				  [w](BitStream& ibs) { return read_values(ibs, w); }, mapped); } });
+	cases.push_back({ "write_exp_golomb/2", [](const Target& t) {
+		return run_write(t, write_golomb, true, true); } });
+	cases.push_back({ "read_exp_golomb/2", [](const Target& t) {
+		return run_read(t, write_golomb, read_golomb, false); } });
+	cases.push_back({ "write_string", [](const Target& t) {
+		return run_write(t, write_strings, true, true); } });
+	cases.push_back({ "read_string", [](const Target& t) {
+		return run_read(t, write_strings, read_strings, false); } });
+
+	ofstream csv;
+	if(not csv_path.empty()) {
+		csv.open(csv_path);
+		csv << "case,target,reps,bits,min_ns_per_bit,median_ns_per_bit,median_mb_per_s\n";
+	}
+
+	printf("%-22s %-10s %12s %12s %10s\n", "case", "target", "min ns/bit", "med ns/bit", "med MB/s");
+	for(const auto& [name, fn] : cases) {
+		// In-memory mmap reads are the same as in-memory reads
+		for(const Target& target : targets) {
+			if(target.path.empty() and name.starts_with("read_n_bits_mmap"))
+				continue;
+
+			for(int r = 0 ; r < n_warmup ; r++)
+				fn(target);
+
+			vector<double> ns_per_bit;
+			double bits { };
+			for(int r = 0 ; r < n_reps ; r++) {
+				Result res = fn(target);
+				bits = res.bits;
+				ns_per_bit.push_back(res.seconds * 1e9 / res.bits);
+			}
+
+			sort(ns_per_bit.begin(), ns_per_bit.end());
+			double med = ns_per_bit[ns_per_bit.size() / 2];
+			double mb_per_s = 1e3 / (8 * med); // bits/ns -> MB/s
+			printf("%-22s %-10s %12.4f %12.4f %10.1f\n", name.c_str(), target.name.c_str(),
+			  ns_per_bit.front(), med, mb_per_s);
+			if(csv.is_open())
+				csv << name << ',' << target.name << ',' << n_reps << ',' << bits << ','
+				  << ns_per_bit.front() << ',' << med << ',' << mb_per_s << '\n';
+		}
+	}
+
+	for(const Target& target : targets)
+		if(not target.path.empty())
+			remove(target.path.c_str());
+
+	return 0;
+}
+
@@ -18,10 +18,14 @@
 //
 #include <iostream>
 #include <fstream>
+#include <vector>
 #include "bit_stream.h"
+#include "bit_text.h"
 
 using namespace std;
 
+constexpr size_t TEXT_BLOCK_SIZE = 1 << 20; // Chars converted per block
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char* argv[]) {
@@ -37,32 +41,25 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	fstream ofs { argv[argc-1], ios::out | ios::binary };
-	if(not ofs.is_open()) {
+	BitStream obs { argv[argc-1], STREAM_WRITE }; // Opened by path: can go through io_uring
+	if(not obs.is_open()) {
 		cerr << "Error opening bin file " << argv[argc-1] << endl;
 		return 1;
 	}
 
-	BitStream obs { ofs, STREAM_WRITE };
-
-	char c;
-	while(ifs.get(c)) {
-		switch(c) {
-			case '0':
-				obs.write_bit(0);
-				break;
-			case '1':
-				obs.write_bit(1);
-				break;
-			case '\n':
-				break;
-			default:
-				cerr << "Error: found invalid char\n";
-				return 1;
+	vector<char> text(TEXT_BLOCK_SIZE);
+	while(ifs.read(text.data(), text.size()) or ifs.gcount() > 0) {
+		if(not text_to_bits(text.data(), ifs.gcount(), obs)) {
+			cerr << "Error: found invalid char\n";
+			return 1;
 		}
 	}
 
 	obs.close();
+	if(obs.failed()) {
+		cerr << "Error writing bin file " << argv[argc-1] << endl;
+		return 1;
+	}
 
 	return 0;
 }
@@ -15,10 +15,15 @@
 // IEETA / DETI / University of Aveiro
 //
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <memory>
 #include <fftw3.h>
-#include <sndfile.hh>
+#include "wav_file.h"
+#include "dct_plan.h"
+#include "dct_float.h"
 
 using namespace std;
 
@@ -27,12 +32,21 @@ int main(int argc, char *argv[]) {
 	bool verbose { false };
 	size_t bs { 1024 };
 	double dctFrac { 0.2 };
+	size_t kBlocks { 0 }; // Blocks per batched transform (0 = fit the L2 cache)
+	bool useFloat { false }; // Single-precision engine (dct_float.h) instead of FFTW
+
+	// One-time training of the FFTW wisdom used by every later run
+	if(int status = dct_train_wisdom_option(argc, argv); status >= 0)
+		return status;
 
 	if(argc < 3) {
 		cerr << "Usage: wav_dct [ -v (verbose) ]\n";
 		cerr << "               [ -bs blockSize (def 1024) ]\n";
 		cerr << "               [ -frac dctFraction (def 0.2) ]\n";
+		cerr << "               [ -k blocksPerTransform (def fits the L2 cache) ]\n";
+		cerr << "               [ -float (single-precision DCT engine) ]\n";
 		cerr << "               wavFileIn wavFileOut\n";
+		cerr << "   or: wav_dct --train-wisdom [ blockSize ... ]\n";
 		return 1;
 	}
 
@@ -48,89 +62,126 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-float") {
+			useFloat = true;
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-k") {
+			kBlocks = max(0, atoi(argv[n+1]));
+			break;
+		}
+
 	for(int n = 1 ; n < argc ; n++)
 		if(string(argv[n]) == "-frac") {
 			dctFrac = atof(argv[n+1]);
 			break;
 		}
 
-	SndfileHandle sfhIn { argv[argc-2] };
-	if(sfhIn.error()) {
-		cerr << "Error: invalid input file\n";
-		return 1;
-    }
-
-	if((sfhIn.format() & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV) {
-		cerr << "Error: file is not in WAV format\n";
+	WavStream wavIn { argv[argc-2] };
+	if(not wavIn.is_open()) {
+		cerr << "Error: invalid input file (" << wavIn.error() << ")\n";
 		return 1;
 	}
 
-	if((sfhIn.format() & SF_FORMAT_SUBMASK) != SF_FORMAT_PCM_16) {
+	const WavInfo& info = wavIn.info();
+	if(info.format != WAV_FORMAT_PCM or info.bits_per_sample != 16) {
 		cerr << "Error: file is not in PCM_16 format\n";
 		return 1;
 	}
 
-	SndfileHandle sfhOut { argv[argc-1], SFM_WRITE, sfhIn.format(),
-	  sfhIn.channels(), sfhIn.samplerate() };
-	if(sfhOut.error()) {
+	ofstream wavOut { argv[argc-1], ios::binary };
+	if(not wavOut.is_open()) {
 		cerr << "Error: invalid output file\n";
 		return 1;
-    }
+	}
 
 	if(verbose) {
 		cout << "Input file has:\n";
-		cout << '\t' << sfhIn.frames() << " frames\n";
-		cout << '\t' << sfhIn.samplerate() << " samples per second\n";
-		cout << '\t' << sfhIn.channels() << " channels\n";
+		cout << '\t' << info.frames << " frames\n";
+		cout << '\t' << info.sample_rate << " samples per second\n";
+		cout << '\t' << info.channels << " channels\n";
 	}
 
-	size_t nChannels { static_cast<size_t>(sfhIn.channels()) };
-	size_t nFrames { static_cast<size_t>(sfhIn.frames()) };
-
-	// Read all samples: c1 c2 ... cn c1 c2 ... cn ...
-	// Note: A frame is a group c1 c2 ... cn
-	vector<short> samples(nChannels * nFrames);
-	sfhIn.readf(samples.data(), nFrames);
+	size_t nChannels { info.channels };
+	size_t nFrames { static_cast<size_t>(info.frames) };
 
 	size_t nBlocks { static_cast<size_t>(ceil(static_cast<double>(nFrames) / bs)) };
 
-	// Do zero padding, if necessary
-	samples.resize(nBlocks * bs * nChannels);
+	// Matrix for holding the DCT computations of K blocks at a time, one
+	// row per block and channel (row j * nChannels + c), all transformed
+	// with a single batched plan
+	size_t K { kBlocks > 0 ? kBlocks : static_cast<size_t>(dct_batch_blocks(bs, nChannels)) };
+	size_t rows { K * nChannels };
+	DctVector x(rows * bs);
+	if(useFloat and not DctFloat::supports(bs)) {
+		cerr << "Warning: no single-precision engine for " << bs << "-point blocks, using FFTW\n";
+		useFloat = false;
+	}
+
+	// With -float the transforms run on the single-precision engine, and
+	// no FFTW plans are made
+	unique_ptr<DctFloat> float_d, float_i;
+	fftw_plan plan_d { }, plan_i { };
+	if(useFloat) {
+		float_d = make_unique<DctFloat>(bs, rows, false);
+		float_i = make_unique<DctFloat>(bs, rows, true);
+		if(verbose)
+			cout << "Using the single-precision DCT engine (" << DctFloat::kernel_name() << ")\n";
+	} else {
+		DctPlanner planner; // Plans from the saved wisdom, if any
+		plan_d = planner.plan_many_r2r(bs, rows, x.data(), x.data(), FFTW_REDFT10);
+		plan_i = planner.plan_many_r2r(bs, rows, x.data(), x.data(), FFTW_REDFT01);
+	}
+
+	// The samples are streamed K blocks at a time: c1 c2 ... cn c1 c2 ... cn ...
+	// Note: A frame is a group c1 c2 ... cn
+	vector<short> samples(K * bs * nChannels);
 
-	// Vector for holding all DCT coefficients, channel by channel
-	vector<vector<double>> x_dct(nChannels, vector<double>(nBlocks * bs));
+	write_wav_header(wavOut, info.channels, info.sample_rate, 16, nFrames);
+	for(size_t n0 = 0 ; n0 < nBlocks ; n0 += K) {
+		size_t nb { min(K, nBlocks - n0) };
+		size_t nRead { wavIn.read_frames(samples.data(), nb * bs) };
 
-	// Vector for holding DCT computations
-	vector<double> x(bs);
+		// Do zero padding, if necessary
+		fill(samples.begin() + nRead * nChannels, samples.end(), 0);
 
-	// Direct DCT
-	fftw_plan plan_d = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT10, FFTW_ESTIMATE);
-	for(size_t n = 0 ; n < nBlocks ; n++)
-		for(size_t c = 0 ; c < nChannels ; c++) {
+		// Direct DCT
+		for(size_t j = 0 ; j < nb ; j++)
 			for(size_t k = 0 ; k < bs ; k++)
-				x[k] = samples[(n * bs + k) * nChannels + c];
+				for(size_t c = 0 ; c < nChannels ; c++)
+					x[(j * nChannels + c) * bs + k] = samples[(j * bs + k) * nChannels + c];
 
+		if(useFloat)
+			float_d->execute(x.data(), x.data());
+		else
 			fftw_execute(plan_d);
-			// Keep only "dctFrac" of the "low frequency" coefficients
-			for(size_t k = 0 ; k < bs * dctFrac ; k++)
-				x_dct[c][n * bs + k] = x[k] / (bs << 1);
 
-		}
-
-	// Inverse DCT
-	fftw_plan plan_i = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
-	for(size_t n = 0 ; n < nBlocks ; n++)
-		for(size_t c = 0 ; c < nChannels ; c++) {
+		// Keep only "dctFrac" of the "low frequency" coefficients
+		for(size_t r = 0 ; r < nb * nChannels ; r++)
 			for(size_t k = 0 ; k < bs ; k++)
-				x[k] = x_dct[c][n * bs + k];
+				x[r * bs + k] = k < bs * dctFrac ? x[r * bs + k] / (bs << 1) : 0.0;
 
+		// Inverse DCT
+		if(useFloat)
+			float_i->execute(x.data(), x.data());
+		else
 			fftw_execute(plan_i);
+
+		for(size_t j = 0 ; j < nb ; j++)
 			for(size_t k = 0 ; k < bs ; k++)
-				samples[(n * bs + k) * nChannels + c] = static_cast<short>(round(x[k]));
+				for(size_t c = 0 ; c < nChannels ; c++)
+					samples[(j * bs + k) * nChannels + c] = static_cast<short>(round(x[(j * nChannels + c) * bs + k]));
 
-		}
+		wavOut.write(reinterpret_cast<const char*>(samples.data()), nRead * nChannels * sizeof(short));
+	}
 
-	sfhOut.writef(samples.data(), sfhIn.frames());
+	if(not useFloat) {
+		fftw_destroy_plan(plan_d);
+		fftw_destroy_plan(plan_i);
+	}
 	return 0;
 }
 
@@ -0,0 +1,320 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#include <fstream>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wav_file.h"
+
+using namespace std;
+
+static uint16_t get_u16(const uint8_t* p) {
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+	return get_u16(p) | (static_cast<uint32_t>(get_u16(p + 2)) << 16);
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+	return get_u32(p) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+//-------------------------------------------------------------------------------------------
+
+WavReader::WavReader(const string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		struct stat st;
+		if(fstat(fd, &st) == 0 and S_ISREG(st.st_mode) and st.st_size > 0) {
+			void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED) {
+				m_map = static_cast<uint8_t*>(map);
+				m_map_size = st.st_size;
+				madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+				m_data = m_map;
+				m_size = m_map_size;
+			}
+		}
+
+		::close(fd);
+	}
+
+	if(m_map == nullptr) {
+		ifstream ifs { path, ios::binary };
+		if(not ifs.is_open()) {
+			m_error = "cannot open " + path;
+			return;
+		}
+
+		m_own_data.assign(istreambuf_iterator<char>(ifs), { });
+		m_data = m_own_data.data();
+		m_size = m_own_data.size();
+	}
+
+	if(not parse())
+		m_info = WavInfo { };
+}
+
+WavReader::~WavReader() {
+	if(m_map != nullptr)
+		munmap(m_map, m_map_size);
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Walks the chunks after "RIFF"/"RF64" <size> "WAVE". Each chunk is a
+// four-byte id, a 32-bit size and the body, padded to an even length. In
+// RF64 files the sizes of the RIFF and data chunks are 0xffffffff and the
+// real ones are in the ds64 chunk, which comes first. "read" gets the next
+// bytes of the file and "skip" jumps over them; the walk stops at the start
+// of the samples. "file_size" limits the data size (unfinished files)
+//
+static bool parse_wav(const function<bool(uint8_t*, size_t)>& read, const function<bool(uint64_t)>& skip,
+  uint64_t file_size, WavInfo& info, string& error) {
+	uint8_t riff[12];
+	if(not read(riff, sizeof(riff)) or (memcmp(riff, "RIFF", 4) != 0 and memcmp(riff, "RF64", 4) != 0)
+	  or memcmp(riff + 8, "WAVE", 4) != 0) {
+		error = "not a RIFF/WAVE file";
+		return false;
+	}
+
+	info.rf64 = memcmp(riff, "RF64", 4) == 0;
+	uint64_t ds64_data_size { };
+	bool has_fmt { }, has_data { };
+	uint64_t pos { sizeof(riff) };
+	uint8_t chunk[8], body[40];
+	while(not has_data and read(chunk, sizeof(chunk))) {
+		uint64_t size = get_u32(chunk + 4);
+		uint64_t used { }; // Bytes of the body already read
+		pos += sizeof(chunk);
+
+		if(memcmp(chunk, "ds64", 4) == 0 and size >= 16) {
+			used = 16;
+			if(not read(body, used))
+				break;
+
+			ds64_data_size = get_u64(body + 8);
+		} else if(memcmp(chunk, "fmt ", 4) == 0 and size >= 16) {
+			used = min<uint64_t>(size, sizeof(body));
+			if(not read(body, used))
+				break;
+
+			info.format = get_u16(body);
+			info.channels = get_u16(body + 2);
+			info.sample_rate = get_u32(body + 4);
+			info.block_align = get_u16(body + 12);
+			info.bits_per_sample = get_u16(body + 14);
+			// EXTENSIBLE: cbSize, valid bits, channel mask, then the sub-format
+			// GUID, whose first two bytes are the format code
+			if(info.format == WAV_FORMAT_EXTENSIBLE) {
+				if(used < sizeof(body)) {
+					error = "truncated WAVE_FORMAT_EXTENSIBLE fmt chunk";
+					return false;
+				}
+
+				info.format = get_u16(body + 24);
+			}
+
+			has_fmt = true;
+		} else if(memcmp(chunk, "data", 4) == 0) {
+			if(info.rf64 and size == 0xffffffff)
+				size = ds64_data_size;
+
+			info.data_offset = pos;
+			info.data_size = min<uint64_t>(size, file_size - pos); // Unfinished files
+			has_data = true;
+			break;
+		}
+
+		if(not skip(size + (size & 1) - used)) // Last, truncated chunk
+			break;
+
+		pos += size + (size & 1);
+	}
+
+	if(not has_fmt) {
+		error = "no fmt chunk";
+		return false;
+	}
+
+	if(not has_data) {
+		error = "no data chunk";
+		return false;
+	}
+
+	if(info.channels == 0 or info.block_align == 0) {
+		error = "invalid fmt chunk";
+		return false;
+	}
+
+	info.frames = info.data_size / info.block_align;
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------
+
+bool WavReader::parse() {
+	size_t pos { };
+	auto read = [&](uint8_t* p, size_t n) {
+		if(n > m_size - pos)
+			return false;
+
+		memcpy(p, m_data + pos, n);
+		pos += n;
+		return true;
+	};
+
+	auto skip = [&](uint64_t n) {
+		if(n > m_size - pos)
+			return false;
+
+		pos += n;
+		return true;
+	};
+
+	return parse_wav(read, skip, m_size, m_info, m_error);
+}
+
+bool WavReader::is_open() const {
+	return m_error.empty() and m_data != nullptr;
+}
+
+const string& WavReader::error() const {
+	return m_error;
+}
+
+const WavInfo& WavReader::info() const {
+	return m_info;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// The PCM payload, whole frames only
+//
+span<const uint8_t> WavReader::data() const {
+	if(not is_open())
+		return { };
+
+	return { m_data + m_info.data_offset, m_info.frames * m_info.block_align };
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// The payload as interleaved 16-bit samples (empty unless the file is
+// 16-bit PCM)
+//
+span<const int16_t> WavReader::samples16() const {
+	if(not is_open() or m_info.format != WAV_FORMAT_PCM or m_info.bits_per_sample != 16
+	  or m_info.data_offset % alignof(int16_t) != 0)
+		return { };
+
+	span<const uint8_t> d = data();
+	return { reinterpret_cast<const int16_t*>(d.data()), d.size() / sizeof(int16_t) };
+}
+
+//-------------------------------------------------------------------------------------------
+
+WavStream::WavStream(const string& path) : m_fs { path, ios::in | ios::binary } {
+	if(not m_fs.is_open()) {
+		m_error = "cannot open " + path;
+		return;
+	}
+
+	uint64_t file_size { UINT64_MAX }; // Unknown for pipes
+	struct stat st;
+	if(stat(path.c_str(), &st) == 0 and S_ISREG(st.st_mode))
+		file_size = st.st_size;
+
+	m_in = make_unique<ByteStream>(m_fs, STREAM_READ);
+	auto read = [&](uint8_t* p, size_t n) {
+		return m_in->read(p, n) == n;
+	};
+
+	auto skip = [&](uint64_t n) {
+		uint8_t buf[4096];
+		for(size_t got ; n != 0 ; n -= got)
+			if((got = m_in->read(buf, min<uint64_t>(n, sizeof(buf)))) == 0)
+				return false;
+
+		return true;
+	};
+
+	if(not parse_wav(read, skip, file_size, m_info, m_error))
+		m_info = WavInfo { };
+
+	m_frames_left = m_info.frames;
+}
+
+bool WavStream::is_open() const {
+	return m_error.empty() and m_in != nullptr;
+}
+
+const string& WavStream::error() const {
+	return m_error;
+}
+
+const WavInfo& WavStream::info() const {
+	return m_info;
+}
+
+//-------------------------------------------------------------------------------------------
+//
+// Reads the next n_frames frames (fewer at the end of the data) and returns
+// how many were read
+//
+size_t WavStream::read_frames(void* frames, size_t n_frames) {
+	if(not is_open())
+		return 0;
+
+	n_frames = min<uint64_t>(n_frames, m_frames_left);
+	size_t got = m_in->read(static_cast<uint8_t*>(frames), n_frames * m_info.block_align) / m_info.block_align;
+	m_frames_left -= got;
+	return got;
+}
+
+//-------------------------------------------------------------------------------------------
+
+bool write_wav_header(ostream& os, uint16_t channels, uint32_t sample_rate,
+  uint16_t bits_per_sample, uint64_t frames) {
+	uint16_t block_align = channels * (bits_per_sample / 8);
+	uint32_t byte_rate = sample_rate * block_align;
+	uint32_t data_size = static_cast<uint32_t>(min<uint64_t>(frames * block_align, 0xffffffff - 36));
+	uint32_t riff_size = 36 + data_size;
+	uint32_t fmt_size { 16 };
+	uint16_t format { WAV_FORMAT_PCM };
+
+	os.write("RIFF", 4);
+	os.write(reinterpret_cast<const char*>(&riff_size), 4);
+	os.write("WAVE", 4);
+	os.write("fmt ", 4);
+	os.write(reinterpret_cast<const char*>(&fmt_size), 4);
+	os.write(reinterpret_cast<const char*>(&format), 2);
+	os.write(reinterpret_cast<const char*>(&channels), 2);
+	os.write(reinterpret_cast<const char*>(&sample_rate), 4);
+	os.write(reinterpret_cast<const char*>(&byte_rate), 4);
+	os.write(reinterpret_cast<const char*>(&block_align), 2);
+	os.write(reinterpret_cast<const char*>(&bits_per_sample), 2);
+	os.write("data", 4);
+	os.write(reinterpret_cast<const char*>(&data_size), 4);
+	return os.good();
+}
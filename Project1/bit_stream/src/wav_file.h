@@ -0,0 +1,111 @@
+//-------------------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+//-------------------------------------------------------------------------------------------
+
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+#include <string>
+#include <vector>
+#include <span>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include "byte_stream.h"
+
+//-------------------------------------------------------------------------------------------
+//
+// Minimal RIFF/WAVE reader, so that the codecs can get at the PCM samples
+// without libsndfile. The chunks are walked in order (LIST, fact, etc. are
+// skipped), WAVE_FORMAT_EXTENSIBLE is reduced to its sub-format and RF64
+// files (over 4 GB) take their sizes from the ds64 chunk. The samples are a
+// view of the file, which is mapped or, if that fails, read in one pass.
+//
+const uint16_t WAV_FORMAT_PCM = 0x0001;
+const uint16_t WAV_FORMAT_IEEE_FLOAT = 0x0003;
+const uint16_t WAV_FORMAT_EXTENSIBLE = 0xfffe;
+
+struct WavInfo {
+	uint16_t	format { WAV_FORMAT_PCM }; // Sub-format, for EXTENSIBLE files
+	uint16_t	channels { };
+	uint32_t	sample_rate { };
+	uint16_t	bits_per_sample { };
+	uint16_t	block_align { }; // Bytes per frame
+	uint64_t	data_offset { }; // Of the samples, from the start of the file
+	uint64_t	data_size { }; // Bytes, limited to what the file really has
+	uint64_t	frames { };
+	bool		rf64 { };
+};
+
+class WavReader {
+  private:
+	uint8_t*				m_map { };
+	size_t					m_map_size { };
+	std::vector<uint8_t>	m_own_data; // When the file cannot be mapped
+	const uint8_t*			m_data { };
+	size_t					m_size { };
+	WavInfo					m_info;
+	std::string				m_error;
+
+	bool parse();
+
+  public:
+	WavReader(const std::string& path);
+	~WavReader();
+
+	WavReader(const WavReader&) = delete;
+	WavReader& operator=(const WavReader&) = delete;
+
+	bool is_open() const;
+	const std::string& error() const;
+	const WavInfo& info() const;
+	std::span<const uint8_t> data() const;
+	std::span<const int16_t> samples16() const;
+};
+
+//-------------------------------------------------------------------------------------------
+//
+// The same parsing, but the samples are read in order, a few frames at a
+// time, through a ByteStream: memory use does not depend on the length of
+// the file, which may also be a pipe
+//
+class WavStream {
+  private:
+	std::fstream				m_fs;
+	std::unique_ptr<ByteStream>	m_in;
+	WavInfo						m_info;
+	std::string					m_error;
+	uint64_t					m_frames_left { };
+
+  public:
+	WavStream(const std::string& path);
+
+	WavStream(const WavStream&) = delete;
+	WavStream& operator=(const WavStream&) = delete;
+
+	bool is_open() const;
+	const std::string& error() const;
+	const WavInfo& info() const;
+	size_t read_frames(void* frames, size_t n_frames);
+};
+
+// Canonical 44-byte header (PCM, no extra chunks) for "frames" frames
+bool write_wav_header(std::ostream& os, uint16_t channels, uint32_t sample_rate,
+  uint16_t bits_per_sample, uint64_t frames);
+
+#endif
@@ -3,8 +3,15 @@
 #include <fstream>
 #include <cstdint>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "bit_stream.h"
+#include "bit_lanes.h"
+#include "wav_quant_header.h"
 
 using namespace std;
 
@@ -21,20 +28,78 @@ void write_little_endian(ofstream &ofs, uint32_t value, int bytes) {
     }
 }
 
+// Dequantisation of a block of 16-bit output: (q << shift) | half_step,
+// stored little-endian, 8 samples per SSE2 instruction
+static void dequantize_block(const uint16_t* q, uint8_t* out, size_t n, int shift, uint16_t half_step) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i half = _mm_set1_epi16(static_cast<short>(half_step));
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q + i));
+        x = _mm_or_si128(_mm_sll_epi16(x, count), half);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), x);
+    }
+#endif
+    for (; i < n; ++i) {
+        uint16_t v = static_cast<uint16_t>((q[i] << shift) | half_step);
+        out[2 * i] = static_cast<uint8_t>(v & 0xFF);
+        out[2 * i + 1] = static_cast<uint8_t>(v >> 8);
+    }
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 6) {
-        cerr << "Usage: " << argv[0] << " <input.enc> <output.wav> <n_bits> <channels> <sample_rate> [orig_bits]\n";
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <input.enc> <output.wav>\n";
+        cerr << "       [ -f firstFrame ] [ -nf numFrames ] (decode only those frames)\n";
+        cerr << "       [ -trunc ] (expand codes without adding half a quantisation step)\n";
+        cerr << "   or, for old .enc files without a header:\n";
+        cerr << "       " << argv[0] << " <input.enc> <output.wav> <n_bits> <channels> <sample_rate> [orig_bits]\n";
+        cerr << "       [ -f firstFrame ] [ -nf numFrames ] [ -lanes ] (input written with -lanes N)\n";
         return 1;
     }
 
     // Parse arguments
     string in_path  = argv[1];
     string out_path = argv[2];
-    int n_bits = stoi(argv[3]);            // bits stored per sample in .enc
-    int channels = stoi(argv[4]);          // 1 or 2
-    int sample_rate = stoi(argv[5]);       // e.g. 44100
+
+    // Everything needed comes from the .enc header (wav_quant_header.h);
+    // old headerless files need the parameters on the command line
+    WavQuantHeader hdr;
+    ifstream ifs_hdr(in_path, ios::in | ios::binary);
+    const bool has_header = hdr.read(ifs_hdr);
+    ifs_hdr.close();
+    const off_t data_offset = has_header ? WavQuantHeader::SIZE : 0;
+
+    int n_bits, channels, sample_rate;
     int orig_bits = 16;
-    if (argc >= 7) orig_bits = stoi(argv[6]);
+    int first_opt = 3;
+    if (has_header) {
+        n_bits = hdr.n_bits;                 // bits stored per sample in .enc
+        channels = hdr.channels;
+        sample_rate = hdr.sample_rate;
+        orig_bits = hdr.orig_bits;
+    } else {
+        if (argc < 6 || argv[3][0] == '-') {
+            cerr << "No header in " << in_path << ": give <n_bits> <channels> <sample_rate>\n";
+            return 1;
+        }
+        n_bits = stoi(argv[3]);              // bits stored per sample in .enc
+        channels = stoi(argv[4]);            // 1 or 2
+        sample_rate = stoi(argv[5]);         // e.g. 44100
+        if (argc >= 7 && argv[6][0] != '-') orig_bits = stoi(argv[6]);
+        first_opt = 6;
+    }
+
+    // Optional frame range
+    uint64_t first_frame = 0;
+    uint64_t num_frames_req = 0; // 0 = up to the end
+    bool use_lanes = has_header && hdr.n_lanes > 0;
+    for (int n = first_opt; n < argc; n++) {
+        if (string(argv[n]) == "-f" && n + 1 < argc) first_frame = stoull(argv[n+1]);
+        if (string(argv[n]) == "-nf" && n + 1 < argc) num_frames_req = stoull(argv[n+1]);
+        if (string(argv[n]) == "-lanes" && !has_header) use_lanes = true;
+    }
 
     // Validate parameters
 
@@ -53,32 +118,78 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Calculate number of frames:
+    // Multi-lane container: the lengths of the lanes give the exact number of samples
+    unique_ptr<BitLaneReader> lanes;
+    if (use_lanes) {
+        lanes = make_unique<BitLaneReader>(in_path, data_offset);
+        if (!lanes->is_open()) {
+            cerr << "Not a multi-lane file: " << in_path << "\n";
+            return 1;
+        }
+    }
+
+    // Calculate number of frames: exact from the header, else
     // total_bits_in_file = in_size * 8
     // bits_per_frame = n_bits * channels
     uint64_t total_bits = in_size * 8ULL;
+    if (lanes) {
+        total_bits = 0;
+        for (int l = 0; l < lanes->n_lanes(); ++l)
+            total_bits += lanes->lane_bits(l) / n_bits * n_bits;
+    }
     uint64_t bits_per_frame = static_cast<uint64_t>(n_bits) * static_cast<uint64_t>(channels);
     if (bits_per_frame == 0) {
         cerr << "Invalid bits_per_frame\n";
         return 1;
     }
-    uint64_t frames = total_bits / bits_per_frame;
+    uint64_t frames = has_header ? hdr.frames : total_bits / bits_per_frame;
     if (frames == 0) {
         cerr << "No frames computed from input size (maybe incorrect n_bits/channels?)\n";
         return 1;
     }
+    // The header gives the number of frames, but the file may have been cut
+    // short: every one of them must be there (in its lane, with -lanes)
+    const uint64_t BLOCK_SAMPLES = 65536; // Samples per block, as in wav_quant_enc
+    if (has_header) {
+        bool truncated = false;
+        if (lanes) {
+            const uint64_t N = lanes->n_lanes();
+            const uint64_t samples = frames * channels;
+            const uint64_t blocks = (samples + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+            for (uint64_t l = 0; l < N && l < blocks; ++l) {
+                uint64_t lane_samples = ((blocks - 1 - l) / N + 1) * BLOCK_SAMPLES;
+                if ((blocks - 1) % N == l) lane_samples -= blocks * BLOCK_SAMPLES - samples; // Last, partial block
+                if (lanes->lane_bits(l) < lane_samples * n_bits) truncated = true;
+            }
+        } else
+            truncated = (in_size - data_offset) * 8 < frames * bits_per_frame;
+        if (truncated) {
+            cerr << "Encoded file truncated\n";
+            return 1;
+        }
+    }
+    if (first_frame >= frames) {
+        cerr << "First frame past the end of the file\n";
+        return 1;
+    }
+    frames -= first_frame;
+    if (num_frames_req != 0 && num_frames_req < frames) frames = num_frames_req;
 
     cout << "Input file bytes: " << in_size << "\n";
     cout << "n_bits: " << n_bits << " channels: " << channels << " sample_rate: " << sample_rate << " orig_bits: " << orig_bits << "\n";
-    cout << "Estimated frames: " << frames << "\n";
+    cout << (has_header ? "Frames: " : "Estimated frames: ") << frames << "\n";
 
-    // Open input .enc using fstream and BitStream
-    fstream ifs_enc { in_path, ios::in | ios::binary };
-    if (!ifs_enc.is_open()) {
+    // Open input .enc as a memory-mapped BitStream
+    BitStream ibs(in_path, data_offset);
+    if (!ibs.is_open()) {
         cerr << "Error opening encoded file: " << in_path << "\n";
         return 1;
     }
-    BitStream ibs(ifs_enc, STREAM_READ);
+    // Every frame takes bits_per_frame bits: jump straight to the first one
+    if (!lanes && first_frame != 0 && !ibs.seek_bit(first_frame * bits_per_frame)) {
+        cerr << "Cannot seek to frame " << first_frame << "\n";
+        return 1;
+    }
 
     // Open output WAV (binary)
     ofstream ofs(out_path, ios::out | ios::binary);
@@ -117,30 +228,99 @@ int main(int argc, char* argv[]) {
     ofs.write("data", 4);
     write_little_endian(ofs, subchunk2_size, 4);
 
-    // For each frame, read channels x n_bits and expand to orig_bits and write
+    // Each sample is expanded back to orig_bits: q << shift, plus half a step
+    // (the midpoint of the quantisation interval) unless -trunc is given
     const int bytes_per_sample = bits_per_sample / 8;
     const int shift = orig_bits - n_bits; // left shift to expand
-    // We'll write signed PCM if orig_bits == 16; we reconstruct as integer then cast to int16_t
-    for (uint64_t f = 0; f < frames; ++f) {
-        for (int ch = 0; ch < channels; ++ch) {
-            uint64_t q = ibs.read_n_bits(n_bits); // quantized value (0 .. 2^n_bits-1)
-            // Expand
-            uint64_t expanded = (q << shift);
-
-            // If original was signed 16-bit two's complement, we need to map expanded (unsigned) to signed range.
-            // This mapping depends on how encoder performed quantization. Here we assume encoder simply right-shifted
-            // the raw 16-bit value (unsigned reinterpretation). We reconstruct by left-shifting back and casting.
+    bool midpoint = true;
+    for (int n = first_opt; n < argc; n++)
+        if (string(argv[n]) == "-trunc") midpoint = false;
+    const uint64_t half_step = midpoint && shift > 0 ? 1ULL << (shift - 1) : 0;
+
+    // Codes are unpacked a block at a time by the fixed-width kernel for n_bits
+    // (looked up once) and, for 16-bit output, dequantised by the SIMD kernel;
+    // widths above 16 fall back to read_n_bits. PCM is written a block at a time
+    BitUnpackFn unpack = bit_unpack_fn(n_bits);
+    const bool fast16 = unpack != nullptr && bytes_per_sample == 2;
+    uint64_t total_samples = frames * channels;
+
+    auto decode_block = [&](BitStream& in, uint16_t* codes, size_t n_samples, uint8_t* out) {
+        if (unpack != nullptr)
+            unpack(in, span<uint16_t>(codes, n_samples));
+
+        if (fast16) {
+            dequantize_block(codes, out, n_samples, shift, static_cast<uint16_t>(half_step));
+            return;
+        }
+
+        for (size_t i = 0; i < n_samples; ++i) {
+            uint64_t q = unpack != nullptr ? codes[i] : in.read_n_bits(n_bits); // quantized value (0 .. 2^n_bits-1)
+            uint64_t expanded = (q << shift) + half_step;
             // Write little-endian bytes of size bytes_per_sample
-            for (int b = 0; b < bytes_per_sample; ++b) {
-                uint8_t outb = static_cast<uint8_t>((expanded >> (8 * b)) & 0xFF);
-                ofs.put(static_cast<char>(outb));
+            for (int b = 0; b < bytes_per_sample; ++b)
+                *out++ = static_cast<uint8_t>((expanded >> (8 * b)) & 0xFF);
+        }
+    };
+
+    if (lanes) {
+        // Block b of the file is in lane b % N. The blocks are decoded a batch
+        // at a time, each lane on its own thread, into a PCM buffer of fixed
+        // size that is written before the next batch
+        const uint64_t N = lanes->n_lanes();
+        const uint64_t first_sample = first_frame * channels;
+        const uint64_t end_sample = first_sample + total_samples;
+        const uint64_t first_block = first_sample / BLOCK_SAMPLES;
+        const uint64_t end_block = (end_sample + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+
+        // Each lane starts at its first block
+        for (uint64_t l = 0; l < N; ++l) {
+            uint64_t b = first_block + (l + N - first_block % N) % N;
+            if (b < end_block && !lanes->lane(l).seek_bit(b / N * BLOCK_SAMPLES * n_bits)) {
+                cerr << "Cannot seek to frame " << first_frame << "\n";
+                return 1;
             }
         }
+
+        const uint64_t BATCH_BLOCKS = 4 * N; // A few blocks per lane
+        vector<uint8_t> pcm(min(BATCH_BLOCKS, end_block - first_block) * BLOCK_SAMPLES * bytes_per_sample);
+        for (uint64_t first = first_block; first < end_block; first += BATCH_BLOCKS) {
+            const uint64_t last = min(end_block, first + BATCH_BLOCKS);
+            lanes->for_each_lane([&](int l, BitStream& lane) {
+                uint64_t b = first + (l + N - first % N) % N; // First block of this lane in the batch
+                if (b >= last)
+                    return;
+
+                vector<uint16_t> codes(BLOCK_SAMPLES);
+                for ( ; b < last; b += N) {
+                    size_t n_samples = static_cast<size_t>(min(BLOCK_SAMPLES, end_sample - b * BLOCK_SAMPLES));
+                    decode_block(lane, codes.data(), n_samples, pcm.data() + (b - first) * BLOCK_SAMPLES * bytes_per_sample);
+                }
+            });
+
+            const uint64_t from = max(first_sample, first * BLOCK_SAMPLES);
+            const uint64_t to = min(end_sample, last * BLOCK_SAMPLES);
+            ofs.write(reinterpret_cast<char*>(pcm.data()) + (from - first * BLOCK_SAMPLES) * bytes_per_sample,
+                      (to - from) * bytes_per_sample);
+        }
+        total_samples = 0; // All written
+    }
+
+    vector<uint16_t> codes(BLOCK_SAMPLES);
+    vector<uint8_t> pcm(BLOCK_SAMPLES * bytes_per_sample);
+    for (uint64_t first = 0; first < total_samples; first += BLOCK_SAMPLES) {
+        size_t n_samples = static_cast<size_t>(min(BLOCK_SAMPLES, total_samples - first));
+        decode_block(ibs, codes.data(), n_samples, pcm.data());
+        ofs.write(reinterpret_cast<char*>(pcm.data()), n_samples * bytes_per_sample);
+    }
+
+    // Um erro de leitura não é o fim do ficheiro
+    if (ibs.failed()) {
+        cerr << "Error reading " << in_path << "\n";
+        return 1;
     }
 
     // Close streams
     ibs.close();
-    ifs_enc.close();
     ofs.close();
 
     cout << "Decoded WAV written to: " << out_path << "\n";
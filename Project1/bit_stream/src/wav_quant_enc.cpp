@@ -1,46 +1,141 @@
 #include "bit_stream.h"
 #include "byte_stream.h"
+#include "bit_lanes.h"
+#include "wav_quant_header.h"
+#include "wav_file.h"
 #include <fstream>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
-int main (int argc, char *argv[]) {	
+// Quantização de um bloco: desloca cada amostra (vista como uint16) "shift"
+// bits para a direita, 8 amostras por instrução SSE2
+static void quantize_block(const uint16_t* in, uint16_t* out, size_t n, int shift) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_srl_epi16(x, count));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = in[i] >> shift;
+}
+
+int main (int argc, char *argv[]) {
 
     if (argc < 4) {
-        cerr << "Usage: " << argv[0] << " <input.wav> <output.enc> <níveis de quantização>" << endl;
+        cerr << "Usage: " << argv[0] << " <input.wav> <output.enc> <níveis de quantização> [ -lanes N ]" << endl;
         return 1;
     }
 
-    fstream inputFile_Wav {argv[1], ios::in | ios::binary};
+    // Os chunks RIFF são percorridos pelo WavReader (LIST, fact, EXTENSIBLE,
+    // RF64); as amostras são lidas diretamente do ficheiro mapeado
+    WavReader wav {argv[1]};
     fstream outputFile_Enc {argv[2], ios::out | ios::binary};
     int n_bits = stoi(argv[3]);
 
-    if (!inputFile_Wav.is_open() || !outputFile_Enc.is_open()) {
+    if (!wav.is_open()) {
+        cerr << "Error reading " << argv[1] << ": " << wav.error() << endl;
+        return 1;
+    }
+    if (!outputFile_Enc.is_open()) {
         cerr << "Error opening files" << endl;
         return 1;
     }
 
-    BitStream obs(outputFile_Enc, STREAM_WRITE);
-    
-    int orig_bits = 16; // bits originais, usados pelo PCM por amostragem. "saber em quantos bits vou reconstituir (ampliar) e salvar o som num formato PCM válido e audível."
-    
-    uint16_t sample;
+    const WavInfo& info = wav.info();
+    WavQuantHeader hdr;
+    hdr.format = info.format;
+    hdr.channels = info.channels;
+    hdr.sample_rate = info.sample_rate;
+    hdr.orig_bits = info.bits_per_sample;
 
-    // Saltar o cabeçalho WAV padrão (44 bytes)
-    inputFile_Wav.seekg(44, ios::beg);
+    int orig_bits = hdr.orig_bits; // bits originais, usados pelo PCM por amostragem. "saber em quantos bits vou reconstituir (ampliar) e salvar o som num formato PCM válido e audível."
+    span<const int16_t> samples = wav.samples16();
+    if (info.format != WAV_FORMAT_PCM || orig_bits != 16) {
+        cerr << "Only 16-bit PCM WAV files are supported" << endl;
+        return 1;
+    }
+    if (n_bits < 1 || n_bits > orig_bits) {
+        cerr << "n_bits must be between 1 and " << orig_bits << endl;
+        return 1;
+    }
 
+    // Número exato de frames: o tamanho do chunk data, limitado ao que o
+    // ficheiro tem de facto (há ficheiros com o tamanho por preencher)
+    hdr.frames = info.frames;
+    hdr.n_bits = n_bits;
 
-    // Lê 8 bytes apontados pelo sizeof e escreve o número de bits usados na quantização no início do arquivo
-    while (inputFile_Wav.read(reinterpret_cast<char*>(&sample), sizeof(sample))) { 
-        int quant_sample = sample >> (orig_bits - n_bits); // quantização
-        obs.write_n_bits(quant_sample, n_bits);
+    // Modo multi-lane (-lanes N): o bloco b vai para a lane b % N, para o
+    // descodificador poder ler as lanes em paralelo
+    int n_lanes = 0;
+    for (int n = 4; n < argc - 1; n++)
+        if (string(argv[n]) == "-lanes") n_lanes = stoi(argv[n+1]);
+    // O cabeçalho guarda o número de lanes em 16 bits
+    if (n_lanes < 0 || n_lanes > UINT16_MAX) {
+        cerr << "-lanes must be between 0 and " << UINT16_MAX << endl;
+        return 1;
+    }
+    hdr.n_lanes = n_lanes;
+
+    if (!hdr.write(outputFile_Enc)) {
+        cerr << "Error writing " << argv[2] << endl;
+        return 1;
+    }
+
+    unique_ptr<BitLaneWriter> lanes;
+    unique_ptr<BitStream> obs_file;
+    if (n_lanes > 0)
+        lanes = make_unique<BitLaneWriter>(n_lanes);
+    else {
+        // O BitStream abre o ficheiro por caminho a seguir ao cabeçalho (e
+        // pode então usar io_uring); escrita assíncrona, 4 buffers
+        outputFile_Enc.close();
+        obs_file = make_unique<BitStream>(argv[2], STREAM_WRITE, WavQuantHeader::SIZE, 4);
+        if (!obs_file->is_open()) {
+            cerr << "Error opening files" << endl;
+            return 1;
+        }
+    }
+
+    // Quantiza blocos de amostras (memória constante) e empacota o bloco
+    // inteiro de uma vez com o kernel de n_bits fixos (escolhido uma só vez);
+    // larguras fora de 1..16 usam write_n_bits amostra a amostra
+    const size_t BLOCK_SAMPLES = 65536;
+    vector<uint16_t> block(BLOCK_SAMPLES);
+    BitPackFn pack = bit_pack_fn(n_bits);
+    const uint16_t* in = reinterpret_cast<const uint16_t*>(samples.data());
+    for (size_t b = 0, pos = 0; pos < samples.size(); ++b, pos += BLOCK_SAMPLES) {
+        size_t n_samples = min(BLOCK_SAMPLES, samples.size() - pos);
+
+        BitStream& obs = lanes ? lanes->lane(b % n_lanes) : *obs_file;
+        quantize_block(in + pos, block.data(), n_samples, orig_bits - n_bits); // quantização
+
+        if (pack != nullptr)
+            pack(obs, span<const uint16_t>(block.data(), n_samples));
+        else
+            for (size_t i = 0; i < n_samples; ++i)
+                obs.write_n_bits(block[i], n_bits);
+    }
+
+    if (lanes)
+        lanes->write(outputFile_Enc);
+    else
+        obs_file->close();
+    if ((obs_file && obs_file->failed()) || outputFile_Enc.bad()) {
+        cerr << "Error writing " << argv[2] << endl;
+        return 1;
     }
-    
-    obs.close();
-    inputFile_Wav.close();
     outputFile_Enc.close();
-    
+
     return 0;
 
 }
@@ -0,0 +1,61 @@
+// wav_quant_header.h
+// Cabeçalho dos ficheiros .enc do wav_quant_enc: tudo o que o descodificador
+// precisa para reconstruir o WAV, sem argumentos extra na linha de comando.
+//
+// Layout (little-endian, 28 bytes):
+//   "WQ01" | uint16 format (1 = PCM) | uint16 channels | uint32 sample_rate |
+//   uint16 orig_bits | uint16 n_bits | uint16 n_lanes (0 = um só stream) |
+//   uint16 reservado | uint64 frames
+// Seguem-se as amostras quantizadas (n_bits cada, intercaladas por canal),
+// ou o contentor multi-lane (bloco b na lane b % n_lanes).
+#ifndef WAV_QUANT_HEADER_H
+#define WAV_QUANT_HEADER_H
+
+#include <cstdint>
+#include <iostream>
+
+struct WavQuantHeader {
+    static const uint32_t MAGIC = 0x31305157; // "WQ01"
+    static const int SIZE = 28;
+
+    uint16_t format = 1;
+    uint16_t channels = 0;
+    uint32_t sample_rate = 0;
+    uint16_t orig_bits = 16;
+    uint16_t n_bits = 0;
+    uint16_t n_lanes = 0;
+    uint64_t frames = 0;
+
+    bool write(std::ostream &os) const {
+        uint32_t magic = MAGIC;
+        uint16_t reserved = 0;
+        os.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        os.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        os.write(reinterpret_cast<const char*>(&channels), sizeof(channels));
+        os.write(reinterpret_cast<const char*>(&sample_rate), sizeof(sample_rate));
+        os.write(reinterpret_cast<const char*>(&orig_bits), sizeof(orig_bits));
+        os.write(reinterpret_cast<const char*>(&n_bits), sizeof(n_bits));
+        os.write(reinterpret_cast<const char*>(&n_lanes), sizeof(n_lanes));
+        os.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+        os.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+        return os.good();
+    }
+
+    // Devolve false se o ficheiro não começar por um cabeçalho válido
+    bool read(std::istream &is) {
+        uint32_t magic = 0;
+        uint16_t reserved;
+        is.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        is.read(reinterpret_cast<char*>(&format), sizeof(format));
+        is.read(reinterpret_cast<char*>(&channels), sizeof(channels));
+        is.read(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
+        is.read(reinterpret_cast<char*>(&orig_bits), sizeof(orig_bits));
+        is.read(reinterpret_cast<char*>(&n_bits), sizeof(n_bits));
+        is.read(reinterpret_cast<char*>(&n_lanes), sizeof(n_lanes));
+        is.read(reinterpret_cast<char*>(&reserved), sizeof(reserved));
+        is.read(reinterpret_cast<char*>(&frames), sizeof(frames));
+        return is.good() && magic == MAGIC && channels != 0 && n_bits >= 1 && n_bits <= orig_bits;
+    }
+};
+
+#endif
@@ -1,18 +1,27 @@
 #include <iostream>
 #include <vector>
+#include <fstream>
+#include <future>
 #include <sndfile.hh>
 #include <cmath>
+#include "wav_cmp.h"
 
 using namespace std;
 
-constexpr size_t FRAMES_BUFFER_SIZE = 65536; // Buffer for reading/writing frames
+constexpr size_t FRAMES_BUFFER_SIZE = 1 << 20; // Buffer for reading/writing frames
 
 int main(int argc, char *argv[]) {
 
     bool verbose { false };
+	size_t blockFrames { 1024 };
+	unsigned nThreads { thread::hardware_concurrency() };
+	string blocksFile;
 
 	if(argc < 3) {
 		cerr << "Usage: wav_cmp [ -v (verbose) ]\n";
+		cerr << "               [ -bs blockSize (def 1024, for the segmental SNR) ]\n";
+		cerr << "               [ -t threads (def one per core) ]\n";
+		cerr << "               [ -blocks blocks.csv (error and SNR of every block) ]\n";
 		cerr << "               wavFileModified wavFileIn\n";
 		return 1;
 	}
@@ -22,6 +31,24 @@ int main(int argc, char *argv[]) {
 			verbose = true;
 			break;
 		}
+
+	for(int n = 1 ; n < argc - 2 ; n++)
+		if(string(argv[n]) == "-bs") {
+			blockFrames = max(1, atoi(argv[n+1]));
+			break;
+		}
+
+	for(int n = 1 ; n < argc - 2 ; n++)
+		if(string(argv[n]) == "-t") {
+			nThreads = max(1, atoi(argv[n+1]));
+			break;
+		}
+
+	for(int n = 1 ; n < argc - 2 ; n++)
+		if(string(argv[n]) == "-blocks") {
+			blocksFile = argv[n+1];
+			break;
+		}
     
     SndfileHandle sfhMod { argv[argc-2] };
 	if(sfhMod.error()) {
@@ -62,46 +89,49 @@ int main(int argc, char *argv[]) {
 		cout << '\t' << sfhIn.channels() << " channels\n";
 	}
 
-    // para cada canal e para cada média de canais:
-    size_t nFrames;
-	vector<short> samplesIn(FRAMES_BUFFER_SIZE * sfhIn.channels());
-    vector<short> samplesMod(FRAMES_BUFFER_SIZE * sfhMod.channels());
-    //short counts = sfhIn.channels();
-
-    size_t channels = sfhIn.channels();
-    vector<long long> sumError2(channels, 0);    // soma dos erros²
-    vector<long long> signalEnergy(channels, 0); // soma dos x²
-    vector<double> maxError(channels, 0.0);           // erro absoluto máximo
-    long long totalSamples = 0;
-
-
-
-    while((nFrames = sfhIn.readf(samplesIn.data(), FRAMES_BUFFER_SIZE))) {
-        // numero de samples lidos
-        size_t nFramesMod = sfhMod.readf(samplesMod.data(), FRAMES_BUFFER_SIZE);
-        if (nFrames != nFramesMod) {
-            cerr << "Error: files have different length\n";
-            return 1;
-        }
-
-        size_t nSamples = nFrames * sfhIn.channels();
-
-            for (size_t i = 0; i < nSamples; ++i) {
-                short x = samplesIn[i];   // original
-                short y = samplesMod[i];  // modificado
+	if(sfhIn.channels() != sfhMod.channels()) {
+		cerr << "Error: files have a different number of channels\n";
+		return 1;
+	}
 
-                double error = static_cast<double>(x) - static_cast<double>(y);
-                // canal a que o sample pertence
-                size_t ch = i % channels;
-                // sum em cada canal
-                sumError2[ch] += 1LL * error * error;           // MSE
-                signalEnergy[ch] += 1LL * x * x;                // SNR
-                maxError[ch] = max(maxError[ch], fabs(error));   // E_inf
+	size_t channels = sfhIn.channels();
+	WAVCmp cmp { channels, blockFrames, nThreads };
+	ofstream blocksOut;
+	if(not blocksFile.empty()) {
+		blocksOut.open(blocksFile);
+		if(not blocksOut.is_open()) {
+			cerr << "Error: cannot write " << blocksFile << '\n';
+			return 1;
+		}
+		cmp.set_blocks_output(blocksOut);
+	}
 
-                totalSamples++;
-        }
+	if(verbose)
+		cout << "Metrics kernel: " << WAVCmp::kernel_name() << '\n';
+
+	// Whole blocks per chunk; the next chunk of both files is read while
+	// the previous one is measured
+	size_t chunkFrames { max<size_t>(1, FRAMES_BUFFER_SIZE / blockFrames) * blockFrames };
+	vector<short> samplesIn[2], samplesMod[2];
+	future<void> measuring;
+	for(int b = 0 ; ; b ^= 1) {
+		samplesIn[b].resize(chunkFrames * channels);
+		samplesMod[b].resize(chunkFrames * channels);
+		size_t nFrames = sfhIn.readf(samplesIn[b].data(), chunkFrames);
+		size_t nFramesMod = sfhMod.readf(samplesMod[b].data(), chunkFrames);
+		if(measuring.valid())
+			measuring.get();
+		if (nFrames != nFramesMod) {
+			cerr << "Error: files have different length\n";
+			return 1;
+		}
+		if(nFrames == 0)
+			break;
 
-    }
+		measuring = async(launch::async, [&cmp, &samplesIn, &samplesMod, b, nFrames] {
+			cmp.update(samplesIn[b].data(), samplesMod[b].data(), nFrames);
+		});
+	}
 
     // The average mean squared error between a certain audio file and its original version
     // MSE = 1/N * sum( (x_i - y_i)^2 ) -> sum(error^2) / N
@@ -114,33 +144,21 @@ int main(int argc, char *argv[]) {
 
 
     for (size_t ch = 0; ch < channels; ++ch) {
-        double mse = static_cast<double>(sumError2[ch]) / (sfhIn.frames());
-        double linf = maxError[ch];
-        double snr = 10.0 * log10(
-            static_cast<double>(signalEnergy[ch]) / sumError2[ch]
-        );
-
         cout << "Channel " << ch << ":\n";
-        cout << "\tMSE  = " << mse << "\n";
-        cout << "\tLinf = " << linf << "\n";
-        cout << "\tSNR  = " << snr << " dB\n";
+        cout << "\tMSE  = " << cmp.mse(ch) << "\n";
+        cout << "\tLinf = " << cmp.linf(ch) << "\n";
+        cout << "\tSNR  = " << cmp.snr(ch) << " dB\n";
     }
 
-    long long sumErrAll = 0, sigAll = 0;
-    double maxAll = 0;
-
-    for (size_t ch = 0; ch < channels; ++ch) {
-        sumErrAll += sumError2[ch];
-        sigAll += signalEnergy[ch];
-        maxAll = max(maxAll, maxError[ch]);
-    }
-
-    double mseAll = static_cast<double>(sumErrAll) / (sfhIn.frames() * channels);
-    double snrAll = 10.0 * log10(static_cast<double>(sigAll) / sumErrAll);
-
     cout << "=== Average over channels ===\n";
-    cout << "\tMSE  = " << mseAll << "\n";
-    cout << "\tLinf = " << maxAll << "\n";
-    cout << "\tSNR  = " << snrAll << " dB\n";
+    cout << "\tMSE  = " << cmp.mse() << "\n";
+    cout << "\tLinf = " << cmp.linf() << "\n";
+    cout << "\tSNR  = " << cmp.snr() << " dB\n";
+
+    // Segmental SNR: mean of the SNR of each block of blockFrames frames
+    cout << "=== Blocks of " << blockFrames << " frames ===\n";
+    cout << "\tSegmental SNR = " << cmp.segmental_snr() << " dB\n";
+    cout << "\tWorst block   = " << cmp.worst() << " (frame " << cmp.worst() * blockFrames
+         << ", Linf = " << cmp.worst_error() << ")\n";
 	return 0;
 }
@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+//
+// Copyright 2025 University of Aveiro, Portugal, All Rights Reserved.
+//
+// These programs are supplied free of charge for research purposes only,
+// and may not be sold or incorporated into any commercial product. There is
+// ABSOLUTELY NO WARRANTY of any sort, nor any undertaking that they are
+// fit for ANY PURPOSE WHATSOEVER. Use them at your own risk. If you do
+// happen to find a bug, or have modifications to suggest, please report
+// the same to Armando J. Pinho, ap@ua.pt. The copyright notice above
+// and this statement of conditions must remain an integral part of each
+// and every copy made of these files.
+//
+// Armando J. Pinho (ap@ua.pt)
+// IEETA / DETI / University of Aveiro
+//
+#ifndef WAVCMP_H
+#define WAVCMP_H
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define WAV_CMP_X86
+#endif
+
+//------------------------------------------------------------------------------
+//
+// Sums of one block of frames, per channel: squared error, signal energy
+// and largest absolute error. All integer, so any split of the work over
+// threads adds up to exactly the same totals
+//
+struct WAVCmpSums {
+	std::vector<uint64_t>	err2;
+	std::vector<uint64_t>	energy;
+	std::vector<uint32_t>	max_err;
+
+	void resize(size_t channels) {
+		err2.assign(channels, 0);
+		energy.assign(channels, 0);
+		max_err.assign(channels, 0);
+	}
+};
+
+typedef void (*WAVCmpKernel)(const short* x, const short* y, size_t n, size_t channels, WAVCmpSums& sums);
+
+//------------------------------------------------------------------------------
+//
+// Kernels: add the "n" interleaved samples of x (original) and y (modified),
+// starting at a frame boundary, to "sums"
+//
+static void wav_cmp_scalar(const short* x, const short* y, size_t n, size_t channels, WAVCmpSums& sums) {
+	for(size_t i = 0 ; i < n ; )
+		for(size_t c = 0 ; c < channels ; c++, i++) {
+			int64_t e { x[i] - y[i] };
+			sums.err2[c] += e * e;
+			sums.energy[c] += int64_t(x[i]) * x[i];
+			sums.max_err[c] = std::max(sums.max_err[c], uint32_t(std::abs(e)));
+		}
+}
+
+#ifdef WAV_CMP_X86
+
+// Eight samples per step, widened to 32 bits (the error needs 17). Lane k of
+// step j of a period holds a sample of channel (8 * j + k) % channels, and a
+// period is the number of steps after which the lanes map to the same
+// channels again, so the accumulators of each step of the period are kept
+// apart and folded into the channels at the end
+__attribute__((target("avx2")))
+static void wav_cmp_avx2(const short* x, const short* y, size_t n, size_t channels, WAVCmpSums& sums) {
+	constexpr size_t MAX_PERIOD = 8;
+	size_t period { channels / std::gcd(channels, size_t(8)) };
+	if(period > MAX_PERIOD) {
+		wav_cmp_scalar(x, y, n, channels, sums);
+		return;
+	}
+
+	// Squares of the even and odd 32-bit lanes, in 64-bit lanes
+	__m256i e2_even[MAX_PERIOD], e2_odd[MAX_PERIOD], x2_even[MAX_PERIOD], x2_odd[MAX_PERIOD], emax[MAX_PERIOD];
+	for(size_t j = 0 ; j < period ; j++)
+		e2_even[j] = e2_odd[j] = x2_even[j] = x2_odd[j] = emax[j] = _mm256_setzero_si256();
+
+	size_t i { 0 };
+	for( ; i + 8 * period <= n ; i += 8 * period)
+		for(size_t j = 0 ; j < period ; j++) {
+			__m256i xv { _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 8 * j))) };
+			__m256i yv { _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i + 8 * j))) };
+			__m256i e { _mm256_sub_epi32(xv, yv) };
+			__m256i e_odd { _mm256_srli_epi64(e, 32) };
+			__m256i x_odd { _mm256_srli_epi64(xv, 32) };
+			e2_even[j] = _mm256_add_epi64(e2_even[j], _mm256_mul_epi32(e, e));
+			e2_odd[j] = _mm256_add_epi64(e2_odd[j], _mm256_mul_epi32(e_odd, e_odd));
+			x2_even[j] = _mm256_add_epi64(x2_even[j], _mm256_mul_epi32(xv, xv));
+			x2_odd[j] = _mm256_add_epi64(x2_odd[j], _mm256_mul_epi32(x_odd, x_odd));
+			emax[j] = _mm256_max_epi32(emax[j], _mm256_abs_epi32(e));
+		}
+
+	for(size_t j = 0 ; j < period ; j++) {
+		alignas(32) uint64_t e2[2][4], x2[2][4];
+		alignas(32) uint32_t m[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(e2[0]), e2_even[j]);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(e2[1]), e2_odd[j]);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(x2[0]), x2_even[j]);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(x2[1]), x2_odd[j]);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(m), emax[j]);
+		for(size_t k = 0 ; k < 8 ; k++) {
+			size_t c { (8 * j + k) % channels };
+			sums.err2[c] += e2[k & 1][k >> 1];
+			sums.energy[c] += x2[k & 1][k >> 1];
+			sums.max_err[c] = std::max(sums.max_err[c], m[k]);
+		}
+	}
+
+	// A whole number of periods is a whole number of frames
+	wav_cmp_scalar(x + i, y + i, n - i, channels, sums);
+}
+
+#endif
+
+static WAVCmpKernel wav_cmp_kernel() {
+#ifdef WAV_CMP_X86
+	if(__builtin_cpu_supports("avx2"))
+		return wav_cmp_avx2;
+#endif
+	return wav_cmp_scalar;
+}
+
+//------------------------------------------------------------------------------
+//
+// Quality metrics of a modified file against its original, fed in chunks
+// of interleaved 16-bit samples. Besides the per-channel totals, the frames
+// are cut into blocks of "block_frames", each with its own SNR (all channels
+// together) and largest error: the segmental SNR is the mean of the block
+// SNRs, clamped to [SEG_SNR_MIN, SEG_SNR_MAX] dB. The blocks of each chunk
+// are spread over the threads and merged in order
+//
+class WAVCmp {
+  private:
+	static constexpr double SEG_SNR_MIN = -10.0;
+	static constexpr double SEG_SNR_MAX = 35.0;
+
+	size_t n_channels;
+	size_t block_frames;
+	unsigned n_threads;
+	WAVCmpKernel kernel { wav_cmp_kernel() };
+	std::ostream* blocks_out { }; // Per-block report, if any
+
+	WAVCmpSums totals;
+	size_t n_frames { };
+	size_t n_blocks { };
+	double seg_snr_sum { };
+	size_t worst_block { };
+	uint32_t worst_err { };
+
+	double block_snr(const WAVCmpSums& s) const {
+		uint64_t err2 { std::accumulate(s.err2.begin(), s.err2.end(), uint64_t(0)) };
+		uint64_t energy { std::accumulate(s.energy.begin(), s.energy.end(), uint64_t(0)) };
+		if(err2 == 0)
+			return SEG_SNR_MAX;
+
+		return std::clamp(10.0 * std::log10(double(energy) / err2), SEG_SNR_MIN, SEG_SNR_MAX);
+	}
+
+  public:
+	WAVCmp(size_t channels, size_t block_frames = 1024,
+	  unsigned n_threads = std::thread::hardware_concurrency()) :
+	  n_channels { channels }, block_frames { std::max<size_t>(1, block_frames) },
+	  n_threads { std::max(1u, n_threads) } {
+		totals.resize(channels);
+	}
+
+	static const char* kernel_name() {
+		return wav_cmp_kernel() == wav_cmp_scalar ? "scalar" : "avx2";
+	}
+
+	// Writes "block,first_frame,max_abs_error,snr_db" for every block
+	void set_blocks_output(std::ostream& out) {
+		blocks_out = &out;
+		out << "block,first_frame,max_abs_error,snr_db\n";
+	}
+
+	// Adds "frames" frames of the original x and the modified y. Every chunk
+	// but the last must hold a whole number of blocks
+	void update(const short* x, const short* y, size_t frames) {
+		size_t nb { (frames + block_frames - 1) / block_frames };
+		std::vector<WAVCmpSums> sums(nb);
+		auto work = [&](size_t b0, size_t b1) {
+			for(size_t b = b0 ; b < b1 ; b++) {
+				size_t first { b * block_frames * n_channels };
+				size_t last { std::min(frames, (b + 1) * block_frames) * n_channels };
+				sums[b].resize(n_channels);
+				kernel(x + first, y + first, last - first, n_channels, sums[b]);
+			}
+		};
+
+		size_t nt { std::min<size_t>(n_threads, nb) };
+		std::vector<std::thread> threads;
+		for(size_t t = 1 ; t < nt ; t++)
+			threads.emplace_back(work, nb * t / nt, nb * (t + 1) / nt);
+		work(0, nt > 0 ? nb / nt : 0);
+		for(auto& th : threads)
+			th.join();
+
+		for(size_t b = 0 ; b < nb ; b++) {
+			const WAVCmpSums& s { sums[b] };
+			uint32_t err { };
+			for(size_t c = 0 ; c < n_channels ; c++) {
+				totals.err2[c] += s.err2[c];
+				totals.energy[c] += s.energy[c];
+				totals.max_err[c] = std::max(totals.max_err[c], s.max_err[c]);
+				err = std::max(err, s.max_err[c]);
+			}
+
+			double snr { block_snr(s) };
+			seg_snr_sum += snr;
+			if(err > worst_err or n_blocks == 0) {
+				worst_err = err;
+				worst_block = n_blocks;
+			}
+
+			if(blocks_out != nullptr)
+				*blocks_out << n_blocks << ',' << n_blocks * block_frames << ',' << err << ',' << snr << '\n';
+			n_blocks++;
+		}
+
+		n_frames += frames;
+	}
+
+	size_t frames() const {
+		return n_frames;
+	}
+
+	// Mean squared error of a channel, per frame
+	double mse(size_t c) const {
+		return n_frames == 0 ? 0.0 : double(totals.err2[c]) / n_frames;
+	}
+
+	double snr(size_t c) const {
+		return 10.0 * std::log10(double(totals.energy[c]) / totals.err2[c]);
+	}
+
+	uint32_t linf(size_t c) const {
+		return totals.max_err[c];
+	}
+
+	// The same over all channels
+	double mse() const {
+		uint64_t err2 { std::accumulate(totals.err2.begin(), totals.err2.end(), uint64_t(0)) };
+		return n_frames == 0 ? 0.0 : double(err2) / (n_frames * n_channels);
+	}
+
+	double snr() const {
+		uint64_t err2 { std::accumulate(totals.err2.begin(), totals.err2.end(), uint64_t(0)) };
+		uint64_t energy { std::accumulate(totals.energy.begin(), totals.energy.end(), uint64_t(0)) };
+		return 10.0 * std::log10(double(energy) / err2);
+	}
+
+	uint32_t linf() const {
+		return *std::max_element(totals.max_err.begin(), totals.max_err.end());
+	}
+
+	double segmental_snr() const {
+		return n_blocks == 0 ? 0.0 : seg_snr_sum / n_blocks;
+	}
+
+	size_t blocks() const {
+		return n_blocks;
+	}
+
+	// Block with the largest absolute error (the first, on ties)
+	size_t worst() const {
+		return worst_block;
+	}
+
+	uint32_t worst_error() const {
+		return worst_err;
+	}
+};
+
+#endif
+
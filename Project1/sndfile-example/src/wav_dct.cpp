@@ -17,6 +17,7 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <fftw3.h>
 #include <sndfile.hh>
 
@@ -85,52 +86,48 @@ int main(int argc, char *argv[]) {
 	}
 
 	size_t nChannels { static_cast<size_t>(sfhIn.channels()) };
-	size_t nFrames { static_cast<size_t>(sfhIn.frames()) };
 
-	// Read all samples: c1 c2 ... cn c1 c2 ... cn ...
+	// The file is processed K blocks at a time, so memory does not grow with
+	// its length. Samples of the current K blocks: c1 c2 ... cn c1 c2 ... cn ...
 	// Note: A frame is a group c1 c2 ... cn
-	vector<short> samples(nChannels * nFrames);
-	sfhIn.readf(samples.data(), nFrames);
-
-	size_t nBlocks { static_cast<size_t>(ceil(static_cast<double>(nFrames) / bs)) };
-
-	// Do zero padding, if necessary
-	samples.resize(nBlocks * bs * nChannels);
-
-	// Vector for holding all DCT coefficients, channel by channel
-	vector<vector<double>> x_dct(nChannels, vector<double>(nBlocks * bs));
+	const size_t K { 64 };
+	vector<short> samples(K * bs * nChannels);
 
 	// Vector for holding DCT computations
 	vector<double> x(bs);
 
-	// Direct DCT
 	fftw_plan plan_d = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT10, FFTW_ESTIMATE);
-	for(size_t n = 0 ; n < nBlocks ; n++)
-		for(size_t c = 0 ; c < nChannels ; c++) {
-			for(size_t k = 0 ; k < bs ; k++)
-				x[k] = samples[(n * bs + k) * nChannels + c];
+	fftw_plan plan_i = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
 
-			fftw_execute(plan_d);
-			// Keep only "dctFrac" of the "low frequency" coefficients
-			for(size_t k = 0 ; k < bs * dctFrac ; k++)
-				x_dct[c][n * bs + k] = x[k] / (bs << 1);
+	sf_count_t nFrames;
+	while((nFrames = sfhIn.readf(samples.data(), K * bs)) > 0) {
+		size_t nBlocks { (static_cast<size_t>(nFrames) + bs - 1) / bs };
 
-		}
+		// Do zero padding, if necessary
+		fill(samples.begin() + nFrames * nChannels, samples.end(), 0);
 
-	// Inverse DCT
-	fftw_plan plan_i = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
-	for(size_t n = 0 ; n < nBlocks ; n++)
-		for(size_t c = 0 ; c < nChannels ; c++) {
-			for(size_t k = 0 ; k < bs ; k++)
-				x[k] = x_dct[c][n * bs + k];
+		for(size_t n = 0 ; n < nBlocks ; n++)
+			for(size_t c = 0 ; c < nChannels ; c++) {
+				for(size_t k = 0 ; k < bs ; k++)
+					x[k] = samples[(n * bs + k) * nChannels + c];
 
-			fftw_execute(plan_i);
-			for(size_t k = 0 ; k < bs ; k++)
-				samples[(n * bs + k) * nChannels + c] = static_cast<short>(round(x[k]));
+				// Direct DCT, keeping only "dctFrac" of the "low frequency" coefficients
+				fftw_execute(plan_d);
+				for(size_t k = 0 ; k < bs ; k++)
+					x[k] = k < bs * dctFrac ? x[k] / (bs << 1) : 0;
 
-		}
+				// Inverse DCT
+				fftw_execute(plan_i);
+				for(size_t k = 0 ; k < bs ; k++)
+					samples[(n * bs + k) * nChannels + c] = static_cast<short>(round(x[k]));
+
+			}
+
+		sfhOut.writef(samples.data(), nFrames);
+	}
 
-	sfhOut.writef(samples.data(), sfhIn.frames());
+	fftw_destroy_plan(plan_d);
+	fftw_destroy_plan(plan_i);
 	return 0;
 }
 
@@ -16,21 +16,41 @@
 //
 #include <iostream>
 #include <vector>
+#include <future>
 #include <sndfile.hh>
 #include "wav_hist.h"
 
 using namespace std;
 
-constexpr size_t FRAMES_BUFFER_SIZE = 65536; // Buffer for reading frames
+constexpr size_t FRAMES_BUFFER_SIZE = 1 << 20; // Buffer for reading frames
 
 int main(int argc, char *argv[]) {
 
-	if(argc < 3) {
-		cerr << "Usage: " << argv[0] << " <input file> <channel>\n";
+	// Options first, then the input file and, unless a report is asked
+	// for, the channel
+	unsigned nThreads { thread::hardware_concurrency() };
+	string csvFile, bundleFile;
+	vector<string> args;
+	for(int n = 1 ; n < argc ; n++) {
+		string opt { argv[n] };
+		if(opt == "-t" and n + 1 < argc)
+			nThreads = max(1, atoi(argv[++n]));
+		else if(opt == "-csv" and n + 1 < argc)
+			csvFile = argv[++n];
+		else if(opt == "-bundle" and n + 1 < argc)
+			bundleFile = argv[++n];
+		else
+			args.push_back(opt);
+	}
+
+	bool report { not csvFile.empty() or not bundleFile.empty() };
+	if(args.size() != 2 and not (report and args.size() == 1)) {
+		cerr << "Usage: " << argv[0] << " [ -t threads ] <input file> <channel>\n";
+		cerr << "       " << argv[0] << " [ -t threads ] [ -csv report.csv ] [ -bundle report.bin ] <input file> [ <channel> ]\n";
 		return 1;
 	}
 
-	SndfileHandle sndFile { argv[argc-2] };
+	SndfileHandle sndFile { args[0].c_str() };
 	if(sndFile.error()) {
 		cerr << "Error: invalid input file\n";
 		return 1;
@@ -46,21 +66,44 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	int channel { stoi(argv[argc-1]) };
-	if(channel >= sndFile.channels()) {
+	int channel { args.size() > 1 ? stoi(args[1]) : -1 };
+	if(channel >= sndFile.channels() or (args.size() > 1 and channel < 0)) {
 		cerr << "Error: invalid channel requested\n";
 		return 1;
 	}
 
+	// Two buffers: the next block is read while the previous one is counted
 	size_t nFrames;
-	vector<short> samples(FRAMES_BUFFER_SIZE * sndFile.channels());
-	WAVHist hist { sndFile };
-	while((nFrames = sndFile.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
-		samples.resize(nFrames * sndFile.channels());
-		hist.update(samples);
+	vector<short> samples[2];
+	future<void> counting;
+	WAVHist hist { sndFile, nThreads };
+	for(int b = 0 ; ; b ^= 1) {
+		samples[b].resize(FRAMES_BUFFER_SIZE * sndFile.channels());
+		nFrames = sndFile.readf(samples[b].data(), FRAMES_BUFFER_SIZE);
+		if(counting.valid())
+			counting.get();
+		if(nFrames == 0)
+			break;
+
+		samples[b].resize(nFrames * sndFile.channels());
+		counting = async(launch::async, [&hist, &samples, b] { hist.update(samples[b]); });
+	}
+
+	// Every stream (each channel, plus mid and side for stereo) was counted
+	// in the same pass
+	if(not csvFile.empty() and not hist.write_csv(csvFile)) {
+		cerr << "Error: cannot write " << csvFile << '\n';
+		return 1;
 	}
 
-	hist.dump(channel);
+	if(not bundleFile.empty() and not hist.write_bundle(bundleFile)) {
+		cerr << "Error: cannot write " << bundleFile << '\n';
+		return 1;
+	}
+
+	if(channel >= 0)
+		hist.dump(channel);
+
 	return 0;
 }
 
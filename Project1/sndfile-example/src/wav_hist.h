@@ -19,81 +19,253 @@
 
 #include <iostream>
 #include <vector>
-#include <map>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <string>
 #include <sndfile.hh>
 
 #include <fstream>
 #include <cmath>
 
+//------------------------------------------------------------------------------
+//
+// Summary of one histogram, for planning the parameters of a codec
+//
+struct WAVHistStats {
+	size_t		samples { };
+	short		min { }, max { };
+	size_t		distinct { }; // Values that occur
+	double		entropy { }; // Shannon entropy, bits per sample
+	unsigned	golomb_m { 1 }; // Golomb parameter with the fewest bits for the interleaved values
+	double		golomb_bits { }; // Bits per sample with golomb_m
+};
+
+//------------------------------------------------------------------------------
+//
+// Histograms of 16-bit samples, one flat array of 65536 counters per stream
+// (each channel, then mid and side for stereo files), indexed by the sample
+// value seen as unsigned. Each thread counts its part of every update into
+// its own sub-histograms, which are only added together when a histogram is
+// asked for
+//
 class WAVHist {
   private:
-	std::vector<std::map<short, size_t>> counts;
-	std::vector<std::map<short, size_t>> counts_mid_side;
+	static constexpr size_t N_VALUES = 65536; // One counter per sample value
+	static constexpr size_t MIN_FRAMES_PER_THREAD = 16384;
+
+	size_t n_channels;
+	size_t n_streams; // Channels, plus mid and side if stereo
+	std::vector<std::vector<size_t>> partial; // Per thread: n_streams * N_VALUES counters
 	// agrupar bins de histograma
 	short bins = 5; // 2^5 = 32
 	short bin_coarser = std::pow(2, bins);
 	std::string output_file = "output_hist";
 
+	// Counts frames [first, last) of "samples" into the sub-histograms "h"
+	void count(const short* samples, size_t first, size_t last, size_t* h) const {
+		if(n_channels == 2) {
+			size_t* left { h };
+			size_t* right { h + N_VALUES };
+			size_t* mid { h + 2 * N_VALUES };
+			size_t* side { h + 3 * N_VALUES };
+			for(size_t i = first ; i < last ; i++) {
+				short L { samples[2 * i] }, R { samples[2 * i + 1] };
+				left[static_cast<uint16_t>(L)]++;
+				right[static_cast<uint16_t>(R)]++;
+				mid[static_cast<uint16_t>(MID(L, R))]++;
+				side[static_cast<uint16_t>(SIDE(L, R))]++;
+			}
+		} else {
+			for(size_t i = first * n_channels ; i < last * n_channels ; )
+				for(size_t c = 0 ; c < n_channels ; c++)
+					h[c * N_VALUES + static_cast<uint16_t>(samples[i++])]++;
+		}
+	}
+
+	// Bits of the Golomb code with parameter m (the quotient in unary, the
+	// remainder in truncated binary) of all values, from below[u], the
+	// number of values smaller than u: O(N_VALUES / m) steps
+	static size_t golomb_bits(const std::vector<size_t>& below, unsigned m) {
+		unsigned b { 0 };
+		while((1u << b) < m)
+			b++;
+
+		unsigned cutoff { (1u << b) - m };
+		size_t n { below[N_VALUES] };
+		size_t bits { n * (1 + b) };
+		for(size_t q = 0 ; q * m < N_VALUES ; q++) {
+			if(q > 0)
+				bits += n - below[q * m]; // One more unary bit for each u >= q * m
+			bits -= below[std::min(q * m + cutoff, N_VALUES)] - below[q * m]; // Short remainders
+		}
+
+		return bits;
+	}
+
+	// Writes the non-empty bins of "h", grouped "group" values per bin (the
+	// bin of a value is value / group, as the old per-sample binning did)
+	static void write(const std::string& path, const std::vector<size_t>& h, short group) {
+		std::vector<size_t> bins(N_VALUES); // Bin b at index b + 32768
+		for(int value = -32768 ; value < 32768 ; value++)
+			bins[value / group + 32768] += h[static_cast<uint16_t>(value)];
+
+		std::ofstream out(path);
+		for(int b = -32768 ; b < 32768 ; b++)
+			if(bins[b + 32768] != 0)
+				out << b << '\t' << bins[b + 32768] << '\n';
+	}
+
   public:
-	WAVHist(const SndfileHandle& sfh) {
-		counts.resize(sfh.channels());
-		counts_mid_side.resize(1);
-		 if(sfh.channels() == 2) {
-            counts_mid_side.resize(2); // cria os mapas para MID e SIDE
-        }
+	WAVHist(const SndfileHandle& sfh, unsigned n_threads = std::thread::hardware_concurrency()) {
+		n_channels = sfh.channels();
+		n_streams = n_channels == 2 ? 4 : n_channels; // cria os contadores para MID e SIDE
+		partial.resize(std::max(1u, n_threads));
+		for(auto& p : partial)
+			p.resize(n_streams * N_VALUES);
 	}
 
+	// Counts a block of interleaved samples, split by frames over the threads
 	void update(const std::vector<short>& samples) {
-		size_t n { };
-		for(auto s : samples)
-			counts[n++ % counts.size()][s]++;
-		// mono -> mid (1 canal)
-		if (counts.size() == 1)
-		{
-			for(size_t i = 0 ; i < samples.size() ; ++i) {
-				counts_mid_side[0][samples[i]/bin_coarser]++;
+		size_t n_frames { samples.size() / n_channels };
+		size_t n_threads { std::clamp<size_t>(n_frames / MIN_FRAMES_PER_THREAD, 1, partial.size()) };
+		std::vector<std::thread> threads;
+		for(size_t t = 1 ; t < n_threads ; t++)
+			threads.emplace_back([this, &samples, n_frames, n_threads, t] {
+				count(samples.data(), n_frames * t / n_threads, n_frames * (t + 1) / n_threads, partial[t].data());
+			});
+
+		count(samples.data(), 0, n_frames / n_threads, partial[0].data());
+		for(auto& th : threads)
+			th.join();
+	}
+
+	size_t streams() const {
+		return n_streams;
+	}
+
+	std::string stream_name(size_t stream) const {
+		if(n_channels == 2 and stream >= 2)
+			return stream == 2 ? "mid" : "side";
+
+		return "ch" + std::to_string(stream);
+	}
+
+	// Merged counters of one stream, indexed by the sample value as unsigned
+	std::vector<size_t> merged(size_t stream) const {
+		std::vector<size_t> h(N_VALUES);
+		for(const auto& p : partial)
+			for(size_t v = 0 ; v < N_VALUES ; v++)
+				h[v] += p[stream * N_VALUES + v];
+
+		return h;
+	}
+
+	// Entropy and best Golomb parameter of one stream. The values are
+	// interleaved (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) as in Golomb.h, and
+	// every parameter is tried
+	WAVHistStats stats(size_t stream) const {
+		std::vector<size_t> h { merged(stream) };
+		std::vector<size_t> below(N_VALUES + 1);
+		WAVHistStats st;
+		for(int value = -32768 ; value < 32768 ; value++) {
+			size_t n { h[static_cast<uint16_t>(value)] };
+			below[value >= 0 ? 2 * value + 1 : -2 * value] = n; // Count of u, for now
+			if(n == 0)
+				continue;
+
+			if(st.samples == 0)
+				st.min = value;
+			st.max = value;
+			st.samples += n;
+			st.distinct++;
+		}
+
+		if(st.samples == 0)
+			return st;
+
+		for(size_t u = 0 ; u < N_VALUES ; u++) {
+			if(below[u + 1] != 0) {
+				double p { static_cast<double>(below[u + 1]) / st.samples };
+				st.entropy -= p * std::log2(p);
 			}
+			below[u + 1] += below[u];
 		}
-		
-		// stereo -> mid + side (2 canais)
-		else if(counts.size() == 2) {
-			// samples: L R L R L R ...
-			for(size_t i = 0 ; i < samples.size() ; i += 2) {
-				// calcula mid e side, com amostras L e R de samples
-				// incrementa os contadores
-				short mid = MID(samples[i], samples[i+1]);
-				short side = SIDE(samples[i], samples[i+1]);
-				counts_mid_side[0][mid/bin_coarser]++;
-				counts_mid_side[1][side/bin_coarser]++;
+
+		size_t best { SIZE_MAX };
+		for(unsigned m = 1 ; m <= N_VALUES ; m++)
+			if(size_t bits = golomb_bits(below, m) ; bits < best) {
+				best = bits;
+				st.golomb_m = m;
 			}
+
+		st.golomb_bits = static_cast<double>(best) / st.samples;
+		return st;
+	}
+
+	// One line per stream with its statistics
+	bool write_csv(const std::string& path) const {
+		std::ofstream out(path);
+		out << "stream,samples,min,max,distinct,entropy,golomb_m,golomb_bits\n";
+		for(size_t s = 0 ; s < n_streams ; s++) {
+			WAVHistStats st { stats(s) };
+			out << stream_name(s) << ',' << st.samples << ',' << st.min << ',' << st.max << ','
+			  << st.distinct << ',' << st.entropy << ',' << st.golomb_m << ',' << st.golomb_bits << '\n';
 		}
+
+		return out.good();
+	}
+
+	// Binary bundle (little-endian): "WHB1" | uint32 number of streams, then
+	// per stream: char[8] name (zero padded) | uint64 samples | double
+	// entropy | uint32 golomb_m | double golomb_bits | uint32 number of
+	// distinct values | that many (int16 value, uint64 count), by value
+	bool write_bundle(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		auto put = [&out](const auto& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+		out.write("WHB1", 4);
+		put(static_cast<uint32_t>(n_streams));
+		for(size_t s = 0 ; s < n_streams ; s++) {
+			std::vector<size_t> h { merged(s) };
+			WAVHistStats st { stats(s) };
+			char name[8] { };
+			stream_name(s).copy(name, sizeof(name));
+			out.write(name, sizeof(name));
+			put(static_cast<uint64_t>(st.samples));
+			put(st.entropy);
+			put(static_cast<uint32_t>(st.golomb_m));
+			put(st.golomb_bits);
+			put(static_cast<uint32_t>(st.distinct));
+			for(int value = -32768 ; value < 32768 ; value++)
+				if(size_t n = h[static_cast<uint16_t>(value)] ; n != 0) {
+					put(static_cast<int16_t>(value));
+					put(static_cast<uint64_t>(n));
+				}
+		}
+
+		return out.good();
 	}
 
 	void dump(const size_t channel) const {
-		std::ofstream out(output_file + "_channel_" + std::to_string(channel) + ".txt");
-		for(auto [value, counter] : counts[channel])
-			out << value << '\t' << counter << '\n';
-        out.close();
-		
-		// se for mono ou stereo, mostra mid
-		std::ofstream out_mid(output_file + "_mid.txt");
-		for(auto [value, counter] : counts_mid_side[0])
-			out_mid << value << '\t' << counter << '\n';
-		out_mid.close();
+		write(output_file + "_channel_" + std::to_string(channel) + ".txt", merged(channel), 1);
+
+		// se for mono ou stereo, mostra mid (em mono, o próprio canal)
+		if(n_channels == 1)
+			write(output_file + "_mid.txt", merged(0), bin_coarser);
+		else if(n_channels == 2)
+			write(output_file + "_mid.txt", merged(2), bin_coarser);
+		else
+			write(output_file + "_mid.txt", std::vector<size_t>(N_VALUES), bin_coarser);
 
 		// se for stereo, mostra mid e side
-		if(counts_mid_side.size() >= 2) {
-			std::ofstream out_side(output_file + "_side.txt");
-			for(auto [value, counter] : counts_mid_side[1])
-				out_side << value << '\t' << counter << '\n';
-        	out_side.close();
-    	}
+		if(n_channels == 2)
+			write(output_file + "_side.txt", merged(3), bin_coarser);
 	}
 
-	short MID(short L, short R) {
+	static short MID(short L, short R) {
 		return (L + R) / 2;
 	}
-	short SIDE(short L, short R) {
+	static short SIDE(short L, short R) {
 		return (L - R) / 2;
 	}
 };